@@ -0,0 +1,49 @@
+#!/bin/sh
+
+# Exo Sense Pi VOC algorithm state persistence
+#
+# Restores the VOC algorithm state saved before the last shutdown, if recent
+# enough, then saves it periodically and on exit.
+#
+#     Copyright (C) 2020-2025 Sfera Labs S.r.l.
+#
+#     For information, visit https://www.sferalabs.cc
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# LICENSE.txt file for more details.
+
+SYSFS_FILE=/sys/class/exosensepi/tha/voc_state
+STATE_DIR=/var/lib/exosensepi
+STATE_FILE=$STATE_DIR/voc_state
+SAVE_INTERVAL=300
+# states should not be restored after interruptions longer than 10 minutes
+MAX_AGE=600
+
+save() {
+	STATE=$(cat $SYSFS_FILE 2>/dev/null) || return
+	echo "$(date +%s) $STATE" > $STATE_FILE.tmp && mv $STATE_FILE.tmp $STATE_FILE
+}
+
+restore() {
+	[ -f $STATE_FILE ] || return
+	read TS S0 S1 < $STATE_FILE || return
+	AGE=$(( $(date +%s) - TS ))
+	if [ $AGE -ge 0 ] && [ $AGE -le $MAX_AGE ]; then
+		echo "$S0 $S1" > $SYSFS_FILE && echo "VOC state restored"
+	else
+		echo "VOC state too old, not restored"
+	fi
+}
+
+mkdir -p $STATE_DIR
+restore
+
+trap 'save; exit 0' TERM INT
+
+while true; do
+	sleep $SAVE_INTERVAL &
+	wait $!
+	save
+done
@@ -1,10 +1,61 @@
 #include "gpio.h"
 #include "../commons/commons.h"
-#include <linux/delay.h>
 #include <linux/interrupt.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
 
 static struct platform_device *_pdev;
 
+unsigned int gpioIrqStormThreshold = 2000;
+
+/*
+ * Raw edge capture of one input at a time. The buffer is allocated when
+ * the capture is started, the IRQ handler only fills it.
+ */
+struct GpioCaptureBean {
+	spinlock_t lock;
+	struct DebouncedGpioBean *deb;
+	struct exosensepi_capture_edge *edges;
+	unsigned int size;
+	unsigned int count;
+	int startValue;
+	ktime_t start;
+	ktime_t deadline;
+	bool running;
+};
+
+static struct GpioCaptureBean gpio_capture = {
+	.lock = __SPIN_LOCK_UNLOCKED(gpio_capture.lock),
+};
+static DEFINE_MUTEX(gpio_capture_mutex);
+
+/*
+ * Called with the capture lock held.
+ */
+static void captureEnd(struct GpioCaptureBean *c) {
+	c->running = false;
+	WRITE_ONCE(c->deb->capture, NULL);
+}
+
+static void captureEdge(struct GpioCaptureBean *c, ktime_t now, int val) {
+	spin_lock(&c->lock);
+	if (c->running) {
+		if (c->count < c->size && ktime_before(now, c->deadline)) {
+			c->edges[c->count].ts_ns = ktime_to_ns(now);
+			c->edges[c->count].value = val;
+			c->edges[c->count].reserved = 0;
+			c->count++;
+		}
+		if (c->count == c->size || !ktime_before(now, c->deadline)) {
+			captureEnd(c);
+		}
+	}
+	spin_unlock(&c->lock);
+}
+
 static void debounceTimerRestart(struct DebouncedGpioBean *deb) {
 	unsigned long debTime_usec;
 
@@ -14,51 +65,380 @@ static void debounceTimerRestart(struct DebouncedGpioBean *deb) {
 		debTime_usec = deb->offMinTime_usec;
 	}
 
-	hrtimer_cancel(&deb->timer);
+	// re-arms the timer if pending, no need to cancel it first
 	hrtimer_start(&deb->timer, ktime_set(0, debTime_usec * 1000),
 			HRTIMER_MODE_REL);
 }
 
+/*
+ * Counts the edge in the current rate window. Returns true if the edges in
+ * the window exceed the storm threshold.
+ */
+static bool debounceEdgeRate(struct DebouncedGpioBean *deb, ktime_t now) {
+	if (ktime_to_ns(ktime_sub(now, deb->stormWinStart))
+			>= GPIO_STORM_WINDOW_NSEC) {
+		deb->edgeRate = deb->stormWinCnt
+				* (NSEC_PER_SEC / GPIO_STORM_WINDOW_NSEC);
+		deb->stormWinStart = now;
+		deb->stormWinCnt = 0;
+	}
+	deb->stormWinCnt++;
+	return gpioIrqStormThreshold > 0
+			&& deb->stormWinCnt * (NSEC_PER_SEC / GPIO_STORM_WINDOW_NSEC)
+					> gpioIrqStormThreshold;
+}
+
 static irqreturn_t debounceIrqHandler(int irq, void *dev) {
 	struct DebouncedGpioBean *deb;
+	struct GpioCaptureBean *capture;
+	ktime_t now;
 	deb = (struct DebouncedGpioBean*) dev;
 	if (deb->irq != irq) {
 		// should never happen
 		return IRQ_HANDLED;
 	}
+	now = ktime_get();
+	atomic64_inc(&deb->edgeCnt);
+	deb->edgeTs = now;
+	capture = READ_ONCE(deb->capture);
+	if (capture != NULL) {
+		// no storm protection while capturing, the capture is bounded
+		captureEdge(capture, now, gpioGetVal(&deb->gpio));
+	} else if (debounceEdgeRate(deb, now)) {
+		// too many edges: switch to sampling until the line is quiet
+		disable_irq_nosync(irq);
+		deb->stormActive = true;
+		deb->stormCnt++;
+		deb->stormStart = now;
+		deb->stormQuietStart = now;
+		deb->stormVal = gpioGetVal(&deb->gpio);
+		hrtimer_start(&deb->stormTimer, ns_to_ktime(GPIO_STORM_SAMPLE_NSEC),
+				HRTIMER_MODE_REL);
+	}
 	debounceTimerRestart(deb);
 	return IRQ_HANDLED;
 }
 
-static enum hrtimer_restart debounceTimerHandler(struct hrtimer *tmr) {
+static enum hrtimer_restart debounceStormTimerHandler(struct hrtimer *tmr) {
 	struct DebouncedGpioBean *deb;
+	ktime_t now;
 	int val;
 
+	deb = container_of(tmr, struct DebouncedGpioBean, stormTimer);
+	if (READ_ONCE(deb->stormStop)) {
+		// the IRQ is being freed, it must not be enabled again
+		return HRTIMER_NORESTART;
+	}
+	now = ktime_get();
+	val = gpioGetVal(&deb->gpio);
+
+	if (val != deb->stormVal) {
+		deb->stormVal = val;
+		atomic64_inc(&deb->edgeCnt);
+		deb->edgeTs = now;
+		deb->stormQuietStart = now;
+		debounceTimerRestart(deb);
+	} else if (ktime_to_ns(ktime_sub(now, deb->stormQuietStart))
+			>= GPIO_STORM_QUIET_NSEC) {
+		deb->stormTime_nsec += ktime_to_ns(ktime_sub(now, deb->stormStart));
+		deb->stormWinStart = now;
+		deb->stormWinCnt = 0;
+		deb->edgeRate = 0;
+		deb->stormActive = false;
+		enable_irq(deb->irq);
+		return HRTIMER_NORESTART;
+	}
+
+	hrtimer_forward_now(tmr, ns_to_ktime(GPIO_STORM_SAMPLE_NSEC));
+	return HRTIMER_RESTART;
+}
+
+static void debounceEventPush(struct DebouncedGpioBean *deb) {
+	struct exosensepi_gpio_event ev;
+	unsigned long flags;
+
+	ev.ts_ns = ktime_to_ns(deb->edgeTs);
+	ev.edges = atomic64_read(&deb->edgeCnt);
+	ev.value = deb->value;
+
+	spin_lock_irqsave(&deb->eventsLock, flags);
+	if (kfifo_is_full(&deb->events)) {
+		// drop the oldest event
+		kfifo_skip(&deb->events);
+		deb->eventsLost++;
+	}
+	ev.lost = deb->eventsLost;
+	deb->eventsLost = 0;
+	kfifo_put(&deb->events, ev);
+	spin_unlock_irqrestore(&deb->eventsLock, flags);
+
+	wake_up_interruptible(&deb->eventsWq);
+}
+
+/*
+ * Moves the gate window forward to the one containing 'now'. Called with
+ * the pulse lock held.
+ */
+static void pulseGateRoll(struct GpioPulseBean *p, ktime_t now) {
+	u64 gate_nsec, elapsed, n;
+
+	gate_nsec = (u64) p->gate_sec * NSEC_PER_SEC;
+	elapsed = ktime_to_ns(ktime_sub(now, p->gateStart));
+	if (elapsed < gate_nsec) {
+		return;
+	}
+	n = div64_u64(elapsed, gate_nsec);
+	// no pulses in the gates after the first elapsed one
+	p->gateLastCnt = n == 1 ? p->gateCnt : 0;
+	p->gateCnt = 0;
+	p->gateStart = ktime_add_ns(p->gateStart, n * gate_nsec);
+	p->gateValid = true;
+}
+
+static void pulseGateReset(struct GpioPulseBean *p, ktime_t now) {
+	p->gateStart = now;
+	p->gateCnt = 0;
+	p->gateLastCnt = 0;
+	p->gateValid = false;
+}
+
+static void pulseAdd(struct GpioPulseBean *p, ktime_t ts) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->lock, flags);
+	pulseGateRoll(p, ktime_get());
+	atomic64_inc(&p->cnt);
+	p->gateCnt++;
+	if (p->lastTs != 0) {
+		p->period_nsec = ktime_to_ns(ktime_sub(ts, p->lastTs));
+	}
+	p->lastTs = ts;
+	spin_unlock_irqrestore(&p->lock, flags);
+}
+
+static enum hrtimer_restart debounceTimerHandler(struct hrtimer *tmr) {
+	struct DebouncedGpioBean *deb;
+	int prev, val;
+
 	deb = container_of(tmr, struct DebouncedGpioBean, timer);
 	val = gpioGetVal(&deb->gpio);
 
 	if (deb->value != val) {
+		prev = deb->value;
+		if (val && prev == 0) {
+			pulseAdd(&deb->pulse, deb->edgeTs);
+		}
 		deb->value = val;
+		if (deb->onChange != NULL) {
+			deb->onChange(deb, prev, val);
+		}
 		if (val) {
-			deb->onCnt++;
+			atomic64_inc(&deb->onCnt);
 		} else {
-			deb->offCnt++;
+			atomic64_inc(&deb->offCnt);
 		}
 		if (deb->notifKn != NULL) {
 			sysfs_notify_dirent(deb->notifKn);
 		}
+		debounceEventPush(deb);
 	}
 
 	return HRTIMER_NORESTART;
 }
 
+/*
+ * Moves the pattern to the next on phase. A pending PWM update takes over
+ * at this period boundary; otherwise the next queued pattern is loaded when
+ * the current one is completed, or when it is a continuous one and
+ * something else is queued. Called with timerLock held.
+ */
+static void patternOn(struct GpioPatternBean *p) {
+	if (p->pendingValid) {
+		p->cur = p->pending;
+		p->remaining = p->cur.rep;
+		p->pendingValid = false;
+	} else if (p->remaining == 0 && (p->cur.rep != 0 || p->count > 0)) {
+		p->cur = p->queue[p->head];
+		p->head = (p->head + 1) % GPIO_PATTERN_QUEUE_SIZE;
+		p->count--;
+		p->remaining = p->cur.rep;
+	}
+	if (p->cur.rep != 0) {
+		p->remaining--;
+	}
+	p->on = true;
+	if (p->cur.onTime_usec > 0) {
+		gpioSetVal(p->gpio, 1);
+	}
+}
+
+static enum hrtimer_restart patternTimerHandler(struct hrtimer *tmr) {
+	struct GpioPatternBean *p;
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	unsigned long flags;
+	unsigned long delay_usec = 0;
+	bool ended = false;
+	ktime_t now, expires;
+
+	p = container_of(tmr, struct GpioPatternBean, timer);
+	now = ktime_get();
+	expires = hrtimer_get_expires(tmr);
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	if (hrtimer_is_queued(tmr)) {
+		// restarted by gpioOutputAtomic() while we waited for the lock
+		spin_unlock_irqrestore(&p->timerLock, flags);
+		return HRTIMER_NORESTART;
+	}
+	if (!p->active) {
+		ret = HRTIMER_NORESTART;
+	} else if (p->on) {
+		p->on = false;
+		if (p->remaining == 0 && p->count == 0 && p->cur.rep != 0
+				&& !p->pendingValid) {
+			gpioSetVal(p->gpio, 0);
+			p->active = false;
+			ended = true;
+			ret = HRTIMER_NORESTART;
+		} else {
+			// no glitch for a zero-length off phase (100% duty)
+			if (p->cur.offTime_usec > 0) {
+				gpioSetVal(p->gpio, 0);
+			}
+			delay_usec = p->cur.offTime_usec;
+		}
+	} else {
+		patternOn(p);
+		delay_usec = p->cur.onTime_usec;
+	}
+	if (ret == HRTIMER_RESTART) {
+		// absolute deadlines, so that the timer latency does not add up
+		hrtimer_set_expires(tmr, ktime_add_us(expires, delay_usec));
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	// lateness of this callback, not of the one just scheduled
+	statsHistAdd(&p->jitter, ktime_us_delta(now, expires));
+	if (ended && p->notifKn != NULL) {
+		sysfs_notify_dirent(p->notifKn);
+	}
+
+	return ret;
+}
+
+static void patternInit(struct GpioBean *g) {
+	struct GpioPatternBean *p = g->pattern;
+
+	if (p == NULL || p->gpio != NULL) {
+		return;
+	}
+	mutex_init(&p->lock);
+	spin_lock_init(&p->timerLock);
+	hrtimer_init(&p->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	p->timer.function = &patternTimerHandler;
+	p->head = 0;
+	p->count = 0;
+	p->remaining = 0;
+	p->pendingValid = false;
+	p->on = false;
+	p->active = false;
+	statsHistInit(&p->jitter, g->name);
+	p->gpio = g;
+}
+
+/*
+ * Stops the running pattern and drops the queued ones. Returns true if a
+ * pattern was active. Called with p->lock held.
+ */
+static bool patternCancel(struct GpioPatternBean *p) {
+	unsigned long flags;
+	bool active;
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	active = p->active;
+	p->active = false;
+	p->count = 0;
+	p->remaining = 0;
+	p->pendingValid = false;
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	hrtimer_cancel(&p->timer);
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	// a pulse from gpioOutputAtomic() may have been armed and cancelled
+	if (p->active) {
+		active = true;
+		p->active = false;
+		p->remaining = 0;
+	}
+	if (active) {
+		p->on = false;
+		gpioSetVal(p->gpio, 0);
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	return active;
+}
+
+/*
+ * Queues a pattern, starting it right away if the player is idle.
+ * Called with p->lock held.
+ */
+static int patternQueue(struct GpioPatternBean *p,
+		struct GpioPatternStep *step) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	if (p->count == GPIO_PATTERN_QUEUE_SIZE) {
+		spin_unlock_irqrestore(&p->timerLock, flags);
+		return -EBUSY;
+	}
+	p->queue[(p->head + p->count) % GPIO_PATTERN_QUEUE_SIZE] = *step;
+	p->count++;
+	if (!p->active) {
+		p->active = true;
+		patternOn(p);
+		// under the lock, not to replace a pulse from gpioOutputAtomic()
+		hrtimer_start(&p->timer,
+				ktime_add_us(ktime_get(), p->cur.onTime_usec),
+				HRTIMER_MODE_ABS);
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	return 0;
+}
+
+/*
+ * Starts a PWM pulse train, or updates the running one at the end of its
+ * current period so that no pulse is cut short. Called with p->lock held.
+ */
+static int patternPwm(struct GpioPatternBean *p, struct GpioPatternStep *step) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	if (p->active && p->cur.pwm && p->count == 0) {
+		p->pending = *step;
+		p->pendingValid = true;
+		spin_unlock_irqrestore(&p->timerLock, flags);
+		return 0;
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	patternCancel(p);
+	return patternQueue(p, step);
+}
+
 void gpioSetPlatformDev(struct platform_device *pdev) {
 	_pdev = pdev;
 }
 
 int gpioInit(struct GpioBean *g) {
 	g->desc = gpiod_get(&_pdev->dev, g->name, g->flags);
-	return IS_ERR(g->desc);
+	if (IS_ERR(g->desc)) {
+		return 1;
+	}
+	patternInit(g);
+	return 0;
 }
 
 int gpioInitDebounce(struct DebouncedGpioBean *d) {
@@ -73,12 +453,39 @@ int gpioInitDebounce(struct DebouncedGpioBean *d) {
 	d->value = DEBOUNCE_STATE_NOT_DEFINED;
 	d->onMinTime_usec = DEBOUNCE_DEFAULT_TIME_USEC;
 	d->offMinTime_usec = DEBOUNCE_DEFAULT_TIME_USEC;
-	d->onCnt = 0;
-	d->offCnt = 0;
+	atomic64_set(&d->onCnt, 0);
+	atomic64_set(&d->offCnt, 0);
+	atomic64_set(&d->edgeCnt, 0);
+	d->edgeTs = ktime_get();
+
+	spin_lock_init(&d->pulse.lock);
+	atomic64_set(&d->pulse.cnt, 0);
+	d->pulse.lastTs = 0;
+	d->pulse.period_nsec = 0;
+	d->pulse.gate_sec = GPIO_PULSE_GATE_DEFAULT_SEC;
+	pulseGateReset(&d->pulse, ktime_get());
+
+	spin_lock_init(&d->eventsLock);
+	init_waitqueue_head(&d->eventsWq);
+	d->eventsLost = 0;
+	if (kfifo_alloc(&d->events, GPIO_EVENTS_SIZE, GFP_KERNEL)) {
+		return -ENOMEM;
+	}
 
 	hrtimer_init(&d->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	d->timer.function = &debounceTimerHandler;
 
+	d->stormWinStart = ktime_get();
+	d->stormWinCnt = 0;
+	d->edgeRate = 0;
+	d->stormActive = false;
+	d->stormStop = false;
+	d->stormCnt = 0;
+	d->stormTime_nsec = 0;
+	hrtimer_init(&d->stormTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	d->stormTimer.function = &debounceStormTimerHandler;
+	d->capture = NULL;
+
 	d->irq = gpiod_to_irq(d->gpio.desc);
 	res = request_irq(d->irq, debounceIrqHandler,
 			(IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING), d->gpio.name, d);
@@ -92,18 +499,166 @@ int gpioInitDebounce(struct DebouncedGpioBean *d) {
 	return res;
 }
 
+/*
+ * Stops gpioOutputAtomic() from driving a line about to change mode, before
+ * its pattern is cancelled and its descriptor put.
+ */
+static void gpioOutputRelease(struct GpioBean *g) {
+	unsigned long flags;
+
+	if (g->pattern == NULL || g->pattern->gpio == NULL) {
+		return;
+	}
+	spin_lock_irqsave(&g->pattern->timerLock, flags);
+	WRITE_ONCE(g->flags, 0);
+	spin_unlock_irqrestore(&g->pattern->timerLock, flags);
+}
+
 void gpioFree(struct GpioBean *g) {
+	if (g->pattern != NULL && g->pattern->gpio != NULL) {
+		mutex_lock(&g->pattern->lock);
+		patternCancel(g->pattern);
+		mutex_unlock(&g->pattern->lock);
+	}
 	if (g->desc != NULL && !IS_ERR(g->desc)) {
 		gpiod_put(g->desc);
 	}
+	g->desc = NULL;
 }
 
 void gpioFreeDebounce(struct DebouncedGpioBean *d) {
-	gpioFree(&d->gpio);
 	if (d->irqRequested) {
+		/*
+		 * A sampler already running completes before the cancel returns,
+		 * later ones leave the IRQ alone. The IRQ handler may still enter
+		 * storm mode until freed, leaving it disabled, which free_irq()
+		 * does not mind.
+		 */
+		WRITE_ONCE(d->stormStop, true);
+		hrtimer_cancel(&d->stormTimer);
 		free_irq(d->irq, d);
+		hrtimer_cancel(&d->stormTimer);
 		hrtimer_cancel(&d->timer);
+		d->stormActive = false;
 		d->irqRequested = false;
+		if (d->capture != NULL) {
+			gpioCaptureStop();
+		}
+	}
+	// after the IRQ and the timers, which read the line
+	gpioFree(&d->gpio);
+	kfifo_free(&d->events);
+}
+
+void gpioDebounceStatsShow(struct seq_file *m, struct DebouncedGpioBean *d) {
+	u64 stormTime_nsec = d->stormTime_nsec;
+	unsigned int edgeRate = d->edgeRate;
+	bool stormActive = d->stormActive;
+	ktime_t now = ktime_get();
+
+	if (stormActive) {
+		stormTime_nsec += ktime_to_ns(ktime_sub(now, d->stormStart));
+	} else if (ktime_to_ns(ktime_sub(now, d->stormWinStart))
+			>= 2 * GPIO_STORM_WINDOW_NSEC) {
+		// no edges in the last window
+		edgeRate = 0;
+	}
+
+	seq_printf(m, "%s: mode=%s edges=%llu rate=%u storms=%lu storm_ms=%llu\n",
+			d->gpio.name, stormActive ? "poll" : "irq",
+			(u64) atomic64_read(&d->edgeCnt),
+			edgeRate, d->stormCnt,
+			div_u64(stormTime_nsec, NSEC_PER_MSEC));
+}
+
+static int gpioEventsOpen(struct inode *inode, struct file *file) {
+	struct GpioEventsDevBean *e;
+
+	e = container_of(file->private_data, struct GpioEventsDevBean, misc);
+	file->private_data = e->deb;
+	return nonseekable_open(inode, file);
+}
+
+/*
+ * Returns as many whole events as fit in the buffer, blocking until at
+ * least one is available unless O_NONBLOCK is set. Events are removed from
+ * the buffer, so concurrent readers of the same input get distinct events.
+ */
+static ssize_t gpioEventsRead(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct DebouncedGpioBean *d = file->private_data;
+	struct exosensepi_gpio_event batch[16];
+	unsigned long flags;
+	unsigned int n;
+	ssize_t copied = 0;
+
+	if (count < sizeof(batch[0])) {
+		return -EINVAL;
+	}
+
+	while (kfifo_is_empty(&d->events)) {
+		if (file->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		if (wait_event_interruptible(d->eventsWq,
+				!kfifo_is_empty(&d->events))) {
+			return -ERESTARTSYS;
+		}
+	}
+
+	while (count - copied >= sizeof(batch[0])) {
+		n = min_t(size_t, ARRAY_SIZE(batch),
+				(count - copied) / sizeof(batch[0]));
+		// copy_to_user() may fault, so it cannot run under the spinlock
+		spin_lock_irqsave(&d->eventsLock, flags);
+		n = kfifo_out(&d->events, batch, n);
+		spin_unlock_irqrestore(&d->eventsLock, flags);
+		if (n == 0) {
+			break;
+		}
+		if (copy_to_user(buf + copied, batch, n * sizeof(batch[0]))) {
+			return -EFAULT;
+		}
+		copied += n * sizeof(batch[0]);
+	}
+
+	return copied;
+}
+
+static __poll_t gpioEventsPoll(struct file *file, poll_table *wait) {
+	struct DebouncedGpioBean *d = file->private_data;
+
+	poll_wait(file, &d->eventsWq, wait);
+	if (!kfifo_is_empty(&d->events)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static const struct file_operations gpioEventsFops = {
+	.owner = THIS_MODULE,
+	.open = gpioEventsOpen,
+	.read = gpioEventsRead,
+	.poll = gpioEventsPoll,
+};
+
+int gpioEventsDevRegister(struct GpioEventsDevBean *e) {
+	int res;
+
+	e->misc.minor = MISC_DYNAMIC_MINOR;
+	e->misc.fops = &gpioEventsFops;
+	res = misc_register(&e->misc);
+	if (res) {
+		return res;
+	}
+	e->registered = true;
+	return 0;
+}
+
+void gpioEventsDevDeregister(struct GpioEventsDevBean *e) {
+	if (e->registered) {
+		misc_deregister(&e->misc);
+		e->registered = false;
 	}
 }
 
@@ -123,6 +678,80 @@ void gpioSetVal(struct GpioBean *g, int val) {
 	gpiod_set_value(g->desc, val);
 }
 
+int gpioOutput(struct GpioBean *g, int val) {
+	if (g->flags != GPIOD_OUT_HIGH && g->flags != GPIOD_OUT_LOW) {
+		return -EPERM;
+	}
+	if (g->pattern != NULL) {
+		// a manual change overrides any blink pattern
+		mutex_lock(&g->pattern->lock);
+		if (patternCancel(g->pattern) && g->pattern->notifKn != NULL) {
+			sysfs_notify_dirent(g->pattern->notifKn);
+		}
+		gpioSetVal(g, val);
+		mutex_unlock(&g->pattern->lock);
+	} else {
+		gpioSetVal(g, val);
+	}
+	return 0;
+}
+
+/*
+ * Sets an output from atomic context, e.g. from a debounce timer. Any
+ * running pattern is stopped without waiting for its timer. With on_usec
+ * > 0 the output is turned on and back off after on_usec, restarting the
+ * time if such a pulse is already running. Outputs without a pattern
+ * player only support on_usec = 0.
+ */
+void gpioOutputAtomic(struct GpioBean *g, int val, unsigned long on_usec) {
+	struct GpioPatternBean *p = g->pattern;
+	unsigned long flags;
+	bool ended = false;
+
+	if (p == NULL) {
+		if (on_usec == 0 && (g->flags == GPIOD_OUT_HIGH
+				|| g->flags == GPIOD_OUT_LOW)) {
+			gpioSetVal(g, val);
+		}
+		return;
+	}
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	// checked under the lock, see gpioOutputRelease()
+	if (g->flags != GPIOD_OUT_HIGH && g->flags != GPIOD_OUT_LOW) {
+		spin_unlock_irqrestore(&p->timerLock, flags);
+		return;
+	}
+	p->count = 0;
+	p->pendingValid = false;
+	if (on_usec > 0) {
+		// single step with no repetitions left, ending after the on phase
+		p->cur.onTime_usec = on_usec;
+		p->cur.offTime_usec = 0;
+		p->cur.rep = 1;
+		p->cur.pwm = false;
+		p->remaining = 0;
+		p->on = true;
+		p->active = true;
+		gpioSetVal(g, 1);
+		hrtimer_start(&p->timer, ktime_add_us(ktime_get(), on_usec),
+				HRTIMER_MODE_ABS);
+	} else {
+		ended = p->active;
+		p->active = false;
+		p->on = false;
+		p->remaining = 0;
+		gpioSetVal(g, val);
+		// the handler finds the pattern inactive if already running
+		hrtimer_try_to_cancel(&p->timer);
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	if (ended && p->notifKn != NULL) {
+		sysfs_notify_dirent(p->notifKn);
+	}
+}
+
 ssize_t devAttrGpioMode_show(struct device *dev, struct device_attribute *attr,
 		char *buf) {
 	struct GpioBean *g;
@@ -151,6 +780,7 @@ ssize_t devAttrGpioMode_store(struct device *dev, struct device_attribute *attr,
 		return -EBUSY;
 	}
 
+	gpioOutputRelease(g);
 	gpioFree(g);
 	g->owner = NULL;
 
@@ -263,26 +893,60 @@ ssize_t devAttrGpio_store(struct device *dev,
 			return -EINVAL;
 		}
 	}
-	gpioSetVal(g, val ? 1 : 0);
+	gpioOutput(g, val ? 1 : 0);
 	return count;
 }
 
+ssize_t devAttrGpioBlink_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct GpioBean *g;
+	g = gpioGetBean(dev, attr);
+	if (g == NULL || g->pattern == NULL) {
+		return -EFAULT;
+	}
+
+	if (g->pattern->notifKn == NULL) {
+		g->pattern->notifKn = sysfs_get_dirent(dev->kobj.sd, attr->attr.name);
+	}
+
+	return sprintf(buf, "%d\n", g->pattern->active ? 1 : 0);
+}
+
 ssize_t devAttrGpioBlink_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count) {
-	int i;
 	long on = 0;
 	long off = 0;
 	long rep = 1;
+	const char *start = buf;
 	char *end = NULL;
+	bool replace = false;
+	struct GpioPatternStep step;
+	struct GpioPatternBean *p;
 	struct GpioBean *g;
+	int ret = 0;
 	g = gpioGetBean(dev, attr);
-	if (g == NULL) {
+	if (g == NULL || g->pattern == NULL) {
 		return -EFAULT;
 	}
 	if (g->flags != GPIOD_OUT_HIGH && g->flags != GPIOD_OUT_LOW) {
 		return -EPERM;
 	}
-	on = simple_strtol(buf, &end, 10);
+	p = g->pattern;
+
+	if (toUpper(buf[0]) == 'C') { // Cancel
+		mutex_lock(&p->lock);
+		if (patternCancel(p) && p->notifKn != NULL) {
+			sysfs_notify_dirent(p->notifKn);
+		}
+		mutex_unlock(&p->lock);
+		return count;
+	}
+	if (buf[0] == '!') { // Replace
+		replace = true;
+		start++;
+	}
+
+	on = simple_strtol(start, &end, 10);
 	if (++end < buf + count) {
 		off = simple_strtol(end, &end, 10);
 		if (++end < buf + count) {
@@ -292,15 +956,25 @@ ssize_t devAttrGpioBlink_store(struct device *dev,
 	if (rep < 1) {
 		rep = 1;
 	}
+	if (off < 0) {
+		off = 0;
+	}
+
+	mutex_lock(&p->lock);
+	if (replace) {
+		patternCancel(p);
+	}
 	if (on > 0) {
-		for (i = 0; i < rep; i++) {
-			gpioSetVal(g, 1);
-			msleep(on);
-			gpioSetVal(g, 0);
-			if (i < rep - 1) {
-				msleep(off);
-			}
-		}
+		step.onTime_usec = on * 1000;
+		step.offTime_usec = off * 1000;
+		step.rep = rep;
+		step.pwm = false;
+		ret = patternQueue(p, &step);
+	}
+	mutex_unlock(&p->lock);
+
+	if (ret < 0) {
+		return ret;
 	}
 	return count;
 }
@@ -317,6 +991,59 @@ static struct DebouncedGpioBean* gpioGetDebouncedBean(struct device *dev,
 	return d;
 }
 
+ssize_t devAttrGpioDebMode_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (d->irqRequested) {
+		return sprintf(buf, "deb\n");
+	}
+	return devAttrGpioMode_show(dev, attr, buf);
+}
+
+/*
+ * Mode of a line that can also be used as debounced input ("deb"). The
+ * debounce attributes of the line fail with EPERM when not in this mode.
+ */
+ssize_t devAttrGpioDebMode_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+
+	if (d->gpio.owner != NULL && d->gpio.owner != attr) {
+		return -EBUSY;
+	}
+
+	if (d->irqRequested) {
+		gpioFreeDebounce(d);
+		d->gpio.flags = 0;
+		d->gpio.owner = NULL;
+	}
+
+	if (toUpper(buf[0]) != 'D') {
+		return devAttrGpioMode_store(dev, attr, buf, count);
+	}
+
+	gpioOutputRelease(&d->gpio);
+	gpioFree(&d->gpio);
+	d->gpio.owner = NULL;
+	d->gpio.flags = GPIOD_IN;
+	if (gpioInitDebounce(d)) {
+		gpioFreeDebounce(d);
+		d->gpio.flags = 0;
+		return -EFAULT;
+	}
+	d->gpio.owner = attr;
+
+	return count;
+}
+
 ssize_t devAttrGpioDeb_show(struct device *dev,
 		struct device_attribute *attr, char *buf) {
 	struct DebouncedGpioBean *d;
@@ -324,6 +1051,9 @@ ssize_t devAttrGpioDeb_show(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
 
 	if (d->notifKn == NULL) {
 		d->notifKn = sysfs_get_dirent(dev->kobj.sd, attr->attr.name);
@@ -339,6 +1069,9 @@ ssize_t devAttrGpioDebMsOn_show(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
 	return sprintf(buf, "%lu\n", d->onMinTime_usec / 1000);
 }
 
@@ -349,6 +1082,9 @@ ssize_t devAttrGpioDebMsOff_show(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
 	return sprintf(buf, "%lu\n", d->offMinTime_usec / 1000);
 }
 
@@ -362,13 +1098,16 @@ ssize_t devAttrGpioDebMsOn_store(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
 	ret = kstrtouint(buf, 10, &val);
 	if (ret < 0) {
 		return ret;
 	}
 	d->onMinTime_usec = val * 1000;
-	d->onCnt = 0;
-	d->offCnt = 0;
+	atomic64_set(&d->onCnt, 0);
+	atomic64_set(&d->offCnt, 0);
 	d->value = DEBOUNCE_STATE_NOT_DEFINED;
 	debounceTimerRestart(d);
 
@@ -385,13 +1124,16 @@ ssize_t devAttrGpioDebMsOff_store(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
 	ret = kstrtouint(buf, 10, &val);
 	if (ret < 0) {
 		return ret;
 	}
 	d->offMinTime_usec = val * 1000;
-	d->onCnt = 0;
-	d->offCnt = 0;
+	atomic64_set(&d->onCnt, 0);
+	atomic64_set(&d->offCnt, 0);
 	d->value = DEBOUNCE_STATE_NOT_DEFINED;
 	debounceTimerRestart(d);
 
@@ -405,7 +1147,10 @@ ssize_t devAttrGpioDebOnCnt_show(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
-	return sprintf(buf, "%lu\n", d->onCnt);
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%llu\n", (u64) atomic64_read(&d->onCnt));
 }
 
 ssize_t devAttrGpioDebOffCnt_show(struct device *dev,
@@ -415,5 +1160,433 @@ ssize_t devAttrGpioDebOffCnt_show(struct device *dev,
 	if (d == NULL) {
 		return -EFAULT;
 	}
-	return sprintf(buf, "%lu\n", d->offCnt);
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%llu\n", (u64) atomic64_read(&d->offCnt));
+}
+
+/*
+ * Read-and-reset variants of the counters: the value returned and the
+ * reset are a single atomic operation, so no event is counted twice or
+ * lost between consecutive reads.
+ */
+ssize_t devAttrGpioDebOnCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%llu\n", (u64) atomic64_xchg(&d->onCnt, 0));
+}
+
+ssize_t devAttrGpioDebOffCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%llu\n", (u64) atomic64_xchg(&d->offCnt, 0));
+}
+
+ssize_t devAttrGpioPulseCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%llu\n", (u64) atomic64_xchg(&d->pulse.cnt, 0));
+}
+
+u64 gpioPulseCount(struct DebouncedGpioBean *d) {
+	return atomic64_read(&d->pulse.cnt);
+}
+
+/*
+ * All values are taken under the pulse lock, so that they are consistent
+ * with each other.
+ */
+ssize_t devAttrGpioPulse_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	unsigned long flags;
+	unsigned long gateLastCnt;
+	unsigned int gate_sec;
+	bool gateValid;
+	u64 cnt, period_nsec;
+	long long rate = -1;
+	long long period = -1;
+	long long freq = -1;
+
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+
+	spin_lock_irqsave(&d->pulse.lock, flags);
+	pulseGateRoll(&d->pulse, ktime_get());
+	cnt = atomic64_read(&d->pulse.cnt);
+	period_nsec = d->pulse.period_nsec;
+	gate_sec = d->pulse.gate_sec;
+	gateLastCnt = d->pulse.gateLastCnt;
+	gateValid = d->pulse.gateValid;
+	spin_unlock_irqrestore(&d->pulse.lock, flags);
+
+	if (gateValid) {
+		// mHz
+		rate = div_u64((u64) gateLastCnt * 1000, gate_sec);
+	}
+	if (period_nsec > 0) {
+		period = div_u64(period_nsec, NSEC_PER_USEC);
+		freq = div64_u64(1000ull * NSEC_PER_SEC, period_nsec);
+	}
+
+	return sprintf(buf, "%llu %lld %lld %lld\n", cnt, rate, period, freq);
+}
+
+ssize_t devAttrGpioPulse_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct DebouncedGpioBean *d;
+	unsigned long flags;
+	unsigned int val;
+	int ret;
+
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val != 0) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&d->pulse.lock, flags);
+	atomic64_set(&d->pulse.cnt, 0);
+	d->pulse.lastTs = 0;
+	d->pulse.period_nsec = 0;
+	pulseGateReset(&d->pulse, ktime_get());
+	spin_unlock_irqrestore(&d->pulse.lock, flags);
+
+	return count;
+}
+
+ssize_t devAttrGpioPulseGate_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct DebouncedGpioBean *d;
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	return sprintf(buf, "%u\n", d->pulse.gate_sec);
+}
+
+ssize_t devAttrGpioPulseGate_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct DebouncedGpioBean *d;
+	unsigned long flags;
+	unsigned int val;
+	int ret;
+
+	d = gpioGetDebouncedBean(dev, attr);
+	if (d == NULL) {
+		return -EFAULT;
+	}
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val != 1 && val != 10 && val != 60) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&d->pulse.lock, flags);
+	d->pulse.gate_sec = val;
+	pulseGateReset(&d->pulse, ktime_get());
+	spin_unlock_irqrestore(&d->pulse.lock, flags);
+
+	return count;
+}
+
+ssize_t devAttrGpioPwm_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct GpioPatternBean *p;
+	struct GpioBean *g;
+	unsigned long flags;
+	unsigned long period = 0;
+	unsigned long duty = 0;
+	unsigned long pulses = 0;
+	g = gpioGetBean(dev, attr);
+	if (g == NULL || g->pattern == NULL || g->pattern->gpio == NULL) {
+		return -EFAULT;
+	}
+	p = g->pattern;
+
+	spin_lock_irqsave(&p->timerLock, flags);
+	if (p->active && p->cur.pwm) {
+		period = p->cur.onTime_usec + p->cur.offTime_usec;
+		duty = div_u64((u64) p->cur.onTime_usec * 1000, period);
+		if (p->cur.rep != 0) {
+			pulses = p->remaining + (p->on ? 1 : 0);
+		}
+	}
+	spin_unlock_irqrestore(&p->timerLock, flags);
+
+	return sprintf(buf, "%lu %lu %lu\n", period, duty, pulses);
+}
+
+ssize_t devAttrGpioPwm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct GpioPatternStep step;
+	struct GpioPatternBean *p;
+	struct GpioBean *g;
+	unsigned long period, duty, pulses = 0;
+	int ret;
+	g = gpioGetBean(dev, attr);
+	if (g == NULL || g->pattern == NULL) {
+		return -EFAULT;
+	}
+	if (g->flags != GPIOD_OUT_HIGH && g->flags != GPIOD_OUT_LOW) {
+		return -EPERM;
+	}
+	p = g->pattern;
+
+	ret = sscanf(buf, "%lu %lu %lu", &period, &duty, &pulses);
+	if (ret < 1) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&p->lock);
+	if (period == 0) {
+		if (p->cur.pwm && patternCancel(p) && p->notifKn != NULL) {
+			sysfs_notify_dirent(p->notifKn);
+		}
+		ret = 0;
+	} else if (ret < 2 || period < GPIO_PWM_MIN_PERIOD_USEC || duty > 1000) {
+		ret = -EINVAL;
+	} else {
+		step.onTime_usec = div_u64((u64) period * duty, 1000);
+		step.offTime_usec = period - step.onTime_usec;
+		step.rep = pulses;
+		step.pwm = true;
+		ret = patternPwm(p, &step);
+	}
+	mutex_unlock(&p->lock);
+
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+
+void gpioPatternStatsShow(struct seq_file *m, struct GpioBean *g) {
+	if (g->pattern != NULL && g->pattern->gpio != NULL) {
+		statsHistShow(m, &g->pattern->jitter, "us");
+	}
+}
+
+void gpioPatternStatsReset(struct GpioBean *g) {
+	if (g->pattern != NULL && g->pattern->gpio != NULL) {
+		statsHistReset(&g->pattern->jitter);
+	}
+}
+
+int gpioCaptureStart(struct DebouncedGpioBean *d, unsigned int maxEdges,
+		unsigned int maxMs) {
+	struct GpioCaptureBean *c = &gpio_capture;
+	struct exosensepi_capture_edge *edges, *old;
+	unsigned long flags;
+
+	if (!d->irqRequested) {
+		return -EPERM;
+	}
+	if (maxEdges == 0 || maxEdges > GPIO_CAPTURE_MAX_EDGES || maxMs == 0
+			|| maxMs > GPIO_CAPTURE_MAX_MSEC) {
+		return -EINVAL;
+	}
+	edges = kvmalloc_array(maxEdges, sizeof(*edges), GFP_KERNEL);
+	if (edges == NULL) {
+		return -ENOMEM;
+	}
+
+	mutex_lock(&gpio_capture_mutex);
+	spin_lock_irqsave(&c->lock, flags);
+	if (c->running) {
+		captureEnd(c);
+	}
+	old = c->edges;
+	c->edges = edges;
+	c->size = maxEdges;
+	c->count = 0;
+	c->deb = d;
+	c->startValue = gpioGetVal(&d->gpio);
+	c->start = ktime_get();
+	c->deadline = ktime_add_ms(c->start, maxMs);
+	c->running = true;
+	WRITE_ONCE(d->capture, c);
+	spin_unlock_irqrestore(&c->lock, flags);
+	mutex_unlock(&gpio_capture_mutex);
+
+	kvfree(old);
+	return 0;
+}
+
+void gpioCaptureStop(void) {
+	struct GpioCaptureBean *c = &gpio_capture;
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	if (c->running) {
+		captureEnd(c);
+	}
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+void gpioCaptureFree(void) {
+	struct GpioCaptureBean *c = &gpio_capture;
+
+	gpioCaptureStop();
+	mutex_lock(&gpio_capture_mutex);
+	kvfree(c->edges);
+	c->edges = NULL;
+	c->size = 0;
+	c->count = 0;
+	c->deb = NULL;
+	mutex_unlock(&gpio_capture_mutex);
+}
+
+static int captureCmp(const void *a, const void *b) {
+	u64 x = *(const u64*) a;
+	u64 y = *(const u64*) b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+ * Longest bounce at the given level, in ns: the durations of the level
+ * between edges are sorted and split at the largest gap (at least x4)
+ * below GPIO_CAPTURE_BOUNCE_MAX_NSEC, shorter ones being bounces and
+ * longer ones stable states. Returns -1 if nothing can be computed.
+ */
+static s64 captureBounceMax(struct GpioCaptureBean *c, unsigned int count,
+		int level) {
+	u64 *d;
+	u64 best = 0, bestRatio = 0, ratio;
+	unsigned int i, n = 0;
+
+	d = kvmalloc_array(count, sizeof(*d), GFP_KERNEL);
+	if (d == NULL) {
+		return -1;
+	}
+	for (i = 0; i + 1 < count; i++) {
+		if (c->edges[i].value == level) {
+			d[n++] = c->edges[i + 1].ts_ns - c->edges[i].ts_ns;
+		}
+	}
+	if (n == 0) {
+		kvfree(d);
+		return -1;
+	}
+	sort(d, n, sizeof(*d), captureCmp, NULL);
+
+	for (i = 1; i < n && d[i - 1] < GPIO_CAPTURE_BOUNCE_MAX_NSEC; i++) {
+		ratio = div64_u64(d[i], d[i - 1] > 0 ? d[i - 1] : 1);
+		if (ratio >= 4 && ratio > bestRatio) {
+			bestRatio = ratio;
+			best = d[i - 1];
+		}
+	}
+	if (bestRatio == 0 && d[n - 1] < GPIO_CAPTURE_BOUNCE_MAX_NSEC) {
+		// bounces only
+		best = d[n - 1];
+	}
+	kvfree(d);
+	return best;
+}
+
+void gpioCaptureShow(struct seq_file *m) {
+	struct GpioCaptureBean *c = &gpio_capture;
+	unsigned long flags;
+	unsigned int count;
+	ktime_t last;
+	bool running;
+	s64 bounce;
+	int level;
+
+	mutex_lock(&gpio_capture_mutex);
+	spin_lock_irqsave(&c->lock, flags);
+	if (c->running && !ktime_before(ktime_get(), c->deadline)) {
+		captureEnd(c);
+	}
+	running = c->running;
+	count = c->count;
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	if (c->deb == NULL) {
+		seq_printf(m, "state=idle\n");
+		mutex_unlock(&gpio_capture_mutex);
+		return;
+	}
+
+	last = count > 0 ? ns_to_ktime(c->edges[count - 1].ts_ns) : c->start;
+	seq_printf(m, "input=%s state=%s edges=%u/%u start_value=%d span_us=%lld\n",
+			c->deb->gpio.name, running ? "running" : "done", count, c->size,
+			c->startValue, ktime_us_delta(last, c->start));
+
+	// levels: 1 for the debounce "on" time, 0 for "off"
+	for (level = 1; level >= 0 && !running; level--) {
+		bounce = captureBounceMax(c, count, level);
+		if (bounce < 0) {
+			seq_printf(m, "deb_%s_ms=?\n", level ? "on" : "off");
+		} else {
+			seq_printf(m, "deb_%s_ms=%llu max_bounce_us=%llu\n",
+					level ? "on" : "off",
+					div_u64(2 * (u64) bounce, NSEC_PER_MSEC) + 1,
+					div_u64((u64) bounce, NSEC_PER_USEC));
+		}
+	}
+	mutex_unlock(&gpio_capture_mutex);
+}
+
+ssize_t gpioCaptureRead(char __user *buf, size_t count, loff_t *ppos) {
+	struct GpioCaptureBean *c = &gpio_capture;
+	unsigned long flags;
+	unsigned int n;
+	ssize_t ret;
+
+	mutex_lock(&gpio_capture_mutex);
+	spin_lock_irqsave(&c->lock, flags);
+	n = c->count;
+	spin_unlock_irqrestore(&c->lock, flags);
+	// the edges below count are no longer written
+	ret = simple_read_from_buffer(buf, count, ppos, c->edges,
+			n * sizeof(*c->edges));
+	mutex_unlock(&gpio_capture_mutex);
+
+	return ret;
 }
@@ -3,10 +3,62 @@
 
 #include <linux/version.h>
 #include <linux/platform_device.h>
+#include <linux/atomic.h>
 #include <linux/gpio/consumer.h>
+#include <linux/kfifo.h>
+#include <linux/miscdevice.h>
+#include <linux/wait.h>
+#include <linux/seq_file.h>
+#include "../stats/stats.h"
+#include "../uapi/exosensepi.h"
 
 #define DEBOUNCE_DEFAULT_TIME_USEC 50000ul
 #define DEBOUNCE_STATE_NOT_DEFINED -1
+#define GPIO_PATTERN_QUEUE_SIZE 8
+#define GPIO_PWM_MIN_PERIOD_USEC 100
+#define GPIO_EVENTS_SIZE 256
+#define GPIO_PULSE_GATE_DEFAULT_SEC 1
+#define GPIO_STORM_WINDOW_NSEC (100 * NSEC_PER_MSEC)
+#define GPIO_STORM_SAMPLE_NSEC (1 * NSEC_PER_MSEC)
+#define GPIO_STORM_QUIET_NSEC (1000 * NSEC_PER_MSEC)
+#define GPIO_CAPTURE_MAX_EDGES 262144
+#define GPIO_CAPTURE_MAX_MSEC 600000
+#define GPIO_CAPTURE_BOUNCE_MAX_NSEC (50 * NSEC_PER_MSEC)
+
+/*
+ * rep 0 repeats the step until cancelled or until another pattern is
+ * queued.
+ */
+struct GpioPatternStep {
+	unsigned long onTime_usec;
+	unsigned long offTime_usec;
+	unsigned long rep;
+	bool pwm;
+};
+
+/*
+ * Blink pattern and PWM player: patterns are queued and played back from an
+ * hrtimer, so that writers never sleep. The output must not be on a
+ * GPIO controller that can sleep. jitter collects the delay of every timer
+ * callback from its deadline.
+ */
+struct GpioPatternBean {
+	struct GpioBean *gpio;
+	struct mutex lock;
+	spinlock_t timerLock;
+	struct hrtimer timer;
+	struct GpioPatternStep queue[GPIO_PATTERN_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int count;
+	struct GpioPatternStep cur;
+	unsigned long remaining;
+	struct GpioPatternStep pending;
+	bool pendingValid;
+	bool on;
+	bool active;
+	struct kernfs_node *notifKn;
+	struct StatsHistBean jitter;
+};
 
 struct GpioBean {
 	const char *name;
@@ -14,8 +66,28 @@ struct GpioBean {
 	enum gpiod_flags flags;
 	bool invert;
 	void *owner;
+	struct GpioPatternBean *pattern;
+};
+
+/*
+ * Pulse (debounced rising edge) counter of an input. gateLastCnt is the
+ * number of pulses in the last completed gate window, gates being rolled
+ * lazily on pulses and reads so that no timer is needed.
+ */
+struct GpioPulseBean {
+	spinlock_t lock;
+	atomic64_t cnt;
+	ktime_t lastTs;
+	u64 period_nsec;
+	unsigned int gate_sec;
+	ktime_t gateStart;
+	unsigned long gateCnt;
+	unsigned long gateLastCnt;
+	bool gateValid;
 };
 
+struct GpioCaptureBean;
+
 struct DebouncedGpioBean {
 	struct GpioBean gpio;
 	int value;
@@ -23,12 +95,47 @@ struct DebouncedGpioBean {
 	bool irqRequested;
 	unsigned long onMinTime_usec;
 	unsigned long offMinTime_usec;
-	unsigned long onCnt;
-	unsigned long offCnt;
+	atomic64_t onCnt;
+	atomic64_t offCnt;
+	atomic64_t edgeCnt;
+	ktime_t edgeTs;
 	struct hrtimer timer;
 	struct kernfs_node *notifKn;
+	spinlock_t eventsLock;
+	DECLARE_KFIFO_PTR(events, struct exosensepi_gpio_event);
+	unsigned int eventsLost;
+	wait_queue_head_t eventsWq;
+	struct GpioPulseBean pulse;
+	ktime_t stormWinStart;
+	unsigned int stormWinCnt;
+	unsigned int edgeRate;
+	bool stormActive;
+	bool stormStop;
+	int stormVal;
+	ktime_t stormStart;
+	ktime_t stormQuietStart;
+	unsigned long stormCnt;
+	u64 stormTime_nsec;
+	struct hrtimer stormTimer;
+	struct GpioCaptureBean *capture;
+	void (*onChange)(struct DebouncedGpioBean *d, int prev, int val);
+};
+
+/*
+ * Character device streaming the debounced value changes of an input.
+ */
+struct GpioEventsDevBean {
+	struct miscdevice misc;
+	struct DebouncedGpioBean *deb;
+	bool registered;
 };
 
+/*
+ * Edges per second above which a debounced input stops using its IRQ and
+ * is sampled every GPIO_STORM_SAMPLE_NSEC until quiet. 0 disables.
+ */
+extern unsigned int gpioIrqStormThreshold;
+
 void gpioSetPlatformDev(struct platform_device *pdev);
 
 int gpioInit(struct GpioBean *g);
@@ -39,16 +146,45 @@ void gpioFree(struct GpioBean *g);
 
 void gpioFreeDebounce(struct DebouncedGpioBean *d);
 
+u64 gpioPulseCount(struct DebouncedGpioBean *d);
+
+int gpioCaptureStart(struct DebouncedGpioBean *d, unsigned int maxEdges,
+		unsigned int maxMs);
+
+void gpioCaptureStop(void);
+
+void gpioCaptureFree(void);
+
+void gpioCaptureShow(struct seq_file *m);
+
+ssize_t gpioCaptureRead(char __user *buf, size_t count, loff_t *ppos);
+
+void gpioDebounceStatsShow(struct seq_file *m, struct DebouncedGpioBean *d);
+
+int gpioEventsDevRegister(struct GpioEventsDevBean *e);
+
+void gpioEventsDevDeregister(struct GpioEventsDevBean *e);
+
 int gpioGetVal(struct GpioBean *g);
 
 void gpioSetVal(struct GpioBean *g, int val);
 
+int gpioOutput(struct GpioBean *g, int val);
+
+void gpioOutputAtomic(struct GpioBean *g, int val, unsigned long on_usec);
+
 ssize_t devAttrGpioMode_show(struct device *dev, struct device_attribute *attr,
 		char *buf);
 
 ssize_t devAttrGpioMode_store(struct device *dev, struct device_attribute *attr,
 		const char *buf, size_t count);
 
+ssize_t devAttrGpioDebMode_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioDebMode_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
 ssize_t devAttrGpio_show(struct device *dev, struct device_attribute *attr,
 		char *buf);
 
@@ -76,9 +212,43 @@ ssize_t devAttrGpioDebOnCnt_show(struct device *dev,
 ssize_t devAttrGpioDebOffCnt_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
+ssize_t devAttrGpioDebOnCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioDebOffCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioPulseCntReset_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioPulse_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioPulse_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrGpioPulseGate_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioPulseGate_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrGpioBlink_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
 ssize_t devAttrGpioBlink_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count);
 
+ssize_t devAttrGpioPwm_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrGpioPwm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+void gpioPatternStatsShow(struct seq_file *m, struct GpioBean *g);
+
+void gpioPatternStatsReset(struct GpioBean *g);
+
 struct GpioBean* gpioGetBean(struct device *dev, struct device_attribute *attr);
 
 #endif
@@ -0,0 +1,120 @@
+#include "history.h"
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+
+static void levelAdd(struct HistoryLevelBean *l, int64_t timeSec,
+		int32_t val) {
+	int64_t ts;
+	s32 rem;
+
+	// 64-bit division is not native on 32-bit ARM
+	div_s64_rem(timeSec, l->periodSec, &rem);
+	ts = timeSec - rem;
+
+	if (l->cur.count > 0 && l->cur.ts != ts) {
+		l->points[l->head] = l->cur;
+		l->head = (l->head + 1) % l->size;
+		if (l->count < l->size) {
+			l->count++;
+		}
+		l->cur.count = 0;
+	}
+
+	if (l->cur.count == 0) {
+		l->cur.ts = ts;
+		l->cur.sum = 0;
+		l->cur.min = val;
+		l->cur.max = val;
+	} else if (val < l->cur.min) {
+		l->cur.min = val;
+	} else if (val > l->cur.max) {
+		l->cur.max = val;
+	}
+	l->cur.sum += val;
+	l->cur.count++;
+}
+
+int historyInit(struct HistoryBean *h, const unsigned int *periodSec,
+		const unsigned int *size) {
+	struct HistoryLevelBean *l;
+	int i;
+
+	spin_lock_init(&h->lock);
+	for (i = 0; i < HISTORY_LEVELS; i++) {
+		l = &h->levels[i];
+		l->periodSec = periodSec[i];
+		l->size = size[i];
+		l->head = 0;
+		l->count = 0;
+		l->cur.count = 0;
+		l->points = kvmalloc_array(size[i], sizeof(*l->points),
+				GFP_KERNEL);
+	}
+	for (i = 0; i < HISTORY_LEVELS; i++) {
+		l = &h->levels[i];
+		if (l->periodSec == 0 || l->size == 0 || l->points == NULL) {
+			historyFree(h);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+void historyFree(struct HistoryBean *h) {
+	int i;
+
+	for (i = 0; i < HISTORY_LEVELS; i++) {
+		kvfree(h->levels[i].points);
+		h->levels[i].points = NULL;
+		h->levels[i].size = 0;
+		h->levels[i].count = 0;
+	}
+}
+
+void historyAdd(struct HistoryBean *h, int64_t timeSec, int32_t val) {
+	int i;
+
+	spin_lock(&h->lock);
+	if (h->levels[0].points != NULL) {
+		for (i = 0; i < HISTORY_LEVELS; i++) {
+			levelAdd(&h->levels[i], timeSec, val);
+		}
+	}
+	spin_unlock(&h->lock);
+}
+
+/*
+ * Copies, oldest first, up to 'max' buckets of the given level starting in
+ * [from, to), including the bucket still being accumulated. Returns the
+ * number of buckets copied.
+ */
+unsigned int historyGet(struct HistoryBean *h, unsigned int level,
+		int64_t from, int64_t to, struct HistoryPoint *points,
+		unsigned int max) {
+	struct HistoryLevelBean *l;
+	struct HistoryPoint *p;
+	unsigned int i, n = 0;
+
+	if (level >= HISTORY_LEVELS) {
+		return 0;
+	}
+	l = &h->levels[level];
+
+	spin_lock(&h->lock);
+	for (i = 0; i <= l->count && n < max; i++) {
+		if (i < l->count) {
+			p = &l->points[(l->head + l->size - l->count + i) % l->size];
+		} else if (l->cur.count > 0) {
+			p = &l->cur;
+		} else {
+			break;
+		}
+		if (p->ts >= from && p->ts < to) {
+			points[n++] = *p;
+		}
+	}
+	spin_unlock(&h->lock);
+
+	return n;
+}
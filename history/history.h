@@ -0,0 +1,53 @@
+#ifndef _SL_HISTORY_H
+#define _SL_HISTORY_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+
+#define HISTORY_LEVELS 3
+
+/*
+ * Aggregate of the samples falling in the bucket [ts, ts + period).
+ */
+struct HistoryPoint {
+	int64_t ts;
+	int64_t sum;
+	int32_t min;
+	int32_t max;
+	uint32_t count;
+};
+
+struct HistoryLevelBean {
+	unsigned int periodSec;
+	unsigned int size;
+	struct HistoryPoint *points;
+	unsigned int head;
+	unsigned int count;
+	struct HistoryPoint cur;
+};
+
+/*
+ * Fixed-memory time series kept at HISTORY_LEVELS resolutions.
+ *
+ * Every level accumulates the incoming samples in its current bucket and
+ * moves it to its ring of completed buckets as soon as a sample for a
+ * different bucket arrives, overwriting the oldest one when full. Adding a
+ * sample costs O(HISTORY_LEVELS) and no downsampling pass is ever needed.
+ */
+struct HistoryBean {
+	spinlock_t lock;
+	struct HistoryLevelBean levels[HISTORY_LEVELS];
+};
+
+int historyInit(struct HistoryBean *h, const unsigned int *periodSec,
+		const unsigned int *size);
+
+void historyFree(struct HistoryBean *h);
+
+void historyAdd(struct HistoryBean *h, int64_t timeSec, int32_t val);
+
+unsigned int historyGet(struct HistoryBean *h, unsigned int level,
+		int64_t from, int64_t to, struct HistoryPoint *points,
+		unsigned int max);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Checks medianGet() against the median taken by copying and sorting the
+ * whole window, as the THA dt filter used to do, and times both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "median.h"
+
+#define CHECK_SAMPLES 20000
+#define BENCH_SAMPLES 20000
+
+/*
+ * The previous implementation: a ring buffer copied and sorted on every
+ * sample, median at index count/2.
+ */
+struct SortMedian {
+	unsigned int size;
+	unsigned int count;
+	unsigned int head;
+	int32_t *buff;
+	int32_t *sort;
+};
+
+static int cmpint32(const void *a, const void *b) {
+	int32_t x = *(const int32_t*) a;
+	int32_t y = *(const int32_t*) b;
+	return (x > y) - (x < y);
+}
+
+static int sortMedianInit(struct SortMedian *s, unsigned int size) {
+	s->size = size;
+	s->count = 0;
+	s->head = 0;
+	s->buff = calloc(size, sizeof(*s->buff));
+	s->sort = calloc(size, sizeof(*s->sort));
+	return s->buff == NULL || s->sort == NULL ? -ENOMEM : 0;
+}
+
+static void sortMedianFree(struct SortMedian *s) {
+	free(s->buff);
+	free(s->sort);
+}
+
+static void sortMedianFill(struct SortMedian *s, int32_t val) {
+	unsigned int i;
+
+	for (i = 0; i < s->size; i++) {
+		s->buff[i] = val;
+	}
+	s->count = s->size;
+	s->head = 0;
+}
+
+static int32_t sortMedianPush(struct SortMedian *s, int32_t val) {
+	s->buff[s->head] = val;
+	s->head = (s->head + 1) % s->size;
+	if (s->count < s->size) {
+		s->count++;
+	}
+	memcpy(s->sort, s->buff, s->count * sizeof(*s->sort));
+	qsort(s->sort, s->count, sizeof(*s->sort), cmpint32);
+	return s->sort[s->count / 2];
+}
+
+/*
+ * Temperature-like samples: a slow drift with noise, spikes and runs of
+ * equal values, so that ties and large jumps are both exercised.
+ */
+static int32_t sample(unsigned int i) {
+	int32_t v = (int32_t) (i % 5000) - 2500 + rand() % 200;
+
+	if (rand() % 50 == 0) {
+		v += (rand() % 2 ? 1 : -1) * 100000;
+	}
+	if (rand() % 10 == 0) {
+		v = 0;
+	}
+	return v;
+}
+
+static int check(unsigned int size, bool fill) {
+	struct MedianBean m;
+	struct SortMedian s;
+	unsigned int i;
+	int32_t v, want, got;
+	int ret = 0;
+
+	if (medianInit(&m, size) || sortMedianInit(&s, size)) {
+		fprintf(stderr, "allocation failed\n");
+		exit(2);
+	}
+	if (fill) {
+		medianFill(&m, 1234);
+		sortMedianFill(&s, 1234);
+	}
+	for (i = 0; i < CHECK_SAMPLES; i++) {
+		v = sample(i);
+		medianPush(&m, v);
+		want = sortMedianPush(&s, v);
+		got = medianGet(&m);
+		if (got != want) {
+			fprintf(stderr, "size %u%s sample %u: got %d, want %d\n", size,
+					fill ? " filled" : "", i, got, want);
+			ret = 1;
+			break;
+		}
+	}
+	medianFree(&m);
+	sortMedianFree(&s);
+	return ret;
+}
+
+static double elapsedNsec(struct timespec *a, struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void bench(unsigned int size) {
+	struct MedianBean m;
+	struct SortMedian s;
+	struct timespec t0, t1;
+	int32_t *vals;
+	volatile int32_t sink;
+	double heapNs, sortNs;
+	unsigned int i;
+
+	vals = malloc(BENCH_SAMPLES * sizeof(*vals));
+	if (vals == NULL || medianInit(&m, size) || sortMedianInit(&s, size)) {
+		fprintf(stderr, "allocation failed\n");
+		exit(2);
+	}
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		vals[i] = sample(i);
+	}
+	medianFill(&m, 0);
+	sortMedianFill(&s, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		medianPush(&m, vals[i]);
+		sink = medianGet(&m);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	heapNs = elapsedNsec(&t0, &t1) / BENCH_SAMPLES;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		sink = sortMedianPush(&s, vals[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sortNs = elapsedNsec(&t0, &t1) / BENCH_SAMPLES;
+	(void) sink;
+
+	printf("%6u samples: heaps %9.1f ns/sample, sort %11.1f ns/sample, "
+			"x%.0f\n", size, heapNs, sortNs, sortNs / heapNs);
+
+	medianFree(&m);
+	sortMedianFree(&s);
+	free(vals);
+}
+
+int main(void) {
+	static const unsigned int sizes[] = { 1, 2, 3, 4, 5, 16, 599, 600, 3600 };
+	static const unsigned int benchSizes[] = { 60, 600, 3600, 21600 };
+	unsigned int i;
+	int ret = 0;
+
+	srand(1);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		ret |= check(sizes[i], false);
+		ret |= check(sizes[i], true);
+	}
+	if (ret) {
+		return ret;
+	}
+	printf("check passed\n");
+
+	for (i = 0; i < sizeof(benchSizes) / sizeof(benchSizes[0]); i++) {
+		bench(benchSizes[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef _SL_BENCH_LINUX_MM_H
+#define _SL_BENCH_LINUX_MM_H
+
+#include <linux/slab.h>
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef _SL_BENCH_LINUX_SLAB_H
+#define _SL_BENCH_LINUX_SLAB_H
+
+#include <stdlib.h>
+
+#define GFP_KERNEL 0
+
+#define kvmalloc_array(n, size, flags) calloc(n, size)
+#define kvfree(p) free(p)
+
+#endif
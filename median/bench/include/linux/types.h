@@ -0,0 +1,12 @@
+/*
+ * Host stand-ins for the kernel headers used by median.c.
+ */
+#ifndef _SL_BENCH_LINUX_TYPES_H
+#define _SL_BENCH_LINUX_TYPES_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#endif
@@ -0,0 +1,233 @@
+#include "median.h"
+#include <linux/mm.h>
+#include <linux/slab.h>
+
+/*
+ * pos[slot] >= 0: index of slot in the low heap
+ * pos[slot] < 0: index -(pos[slot] + 1) of slot in the high heap
+ */
+#define HIGH_POS(i) (-((int) (i)) - 1)
+
+static bool lowLess(struct MedianBean *m, unsigned int i, unsigned int j) {
+	// max-heap: parent must not be smaller than children
+	return m->data[m->low[i]] < m->data[m->low[j]];
+}
+
+static bool highLess(struct MedianBean *m, unsigned int i, unsigned int j) {
+	// min-heap: parent must not be greater than children
+	return m->data[m->high[i]] > m->data[m->high[j]];
+}
+
+static void lowSwap(struct MedianBean *m, unsigned int i, unsigned int j) {
+	unsigned int s = m->low[i];
+	m->low[i] = m->low[j];
+	m->low[j] = s;
+	m->pos[m->low[i]] = i;
+	m->pos[m->low[j]] = j;
+}
+
+static void highSwap(struct MedianBean *m, unsigned int i, unsigned int j) {
+	unsigned int s = m->high[i];
+	m->high[i] = m->high[j];
+	m->high[j] = s;
+	m->pos[m->high[i]] = HIGH_POS(i);
+	m->pos[m->high[j]] = HIGH_POS(j);
+}
+
+static void lowSiftUp(struct MedianBean *m, unsigned int i) {
+	while (i > 0 && lowLess(m, (i - 1) / 2, i)) {
+		lowSwap(m, (i - 1) / 2, i);
+		i = (i - 1) / 2;
+	}
+}
+
+static void highSiftUp(struct MedianBean *m, unsigned int i) {
+	while (i > 0 && highLess(m, (i - 1) / 2, i)) {
+		highSwap(m, (i - 1) / 2, i);
+		i = (i - 1) / 2;
+	}
+}
+
+static void lowSiftDown(struct MedianBean *m, unsigned int i) {
+	unsigned int c;
+	while ((c = 2 * i + 1) < m->lowCnt) {
+		if (c + 1 < m->lowCnt && lowLess(m, c, c + 1)) {
+			c++;
+		}
+		if (!lowLess(m, i, c)) {
+			break;
+		}
+		lowSwap(m, i, c);
+		i = c;
+	}
+}
+
+static void highSiftDown(struct MedianBean *m, unsigned int i) {
+	unsigned int c;
+	while ((c = 2 * i + 1) < m->highCnt) {
+		if (c + 1 < m->highCnt && highLess(m, c, c + 1)) {
+			c++;
+		}
+		if (!highLess(m, i, c)) {
+			break;
+		}
+		highSwap(m, i, c);
+		i = c;
+	}
+}
+
+static void lowInsert(struct MedianBean *m, unsigned int slot) {
+	m->low[m->lowCnt] = slot;
+	m->pos[slot] = m->lowCnt;
+	m->lowCnt++;
+	lowSiftUp(m, m->lowCnt - 1);
+}
+
+static void highInsert(struct MedianBean *m, unsigned int slot) {
+	m->high[m->highCnt] = slot;
+	m->pos[slot] = HIGH_POS(m->highCnt);
+	m->highCnt++;
+	highSiftUp(m, m->highCnt - 1);
+}
+
+static unsigned int lowPopTop(struct MedianBean *m) {
+	unsigned int slot = m->low[0];
+	m->lowCnt--;
+	if (m->lowCnt > 0) {
+		m->low[0] = m->low[m->lowCnt];
+		m->pos[m->low[0]] = 0;
+		lowSiftDown(m, 0);
+	}
+	return slot;
+}
+
+static unsigned int highPopTop(struct MedianBean *m) {
+	unsigned int slot = m->high[0];
+	m->highCnt--;
+	if (m->highCnt > 0) {
+		m->high[0] = m->high[m->highCnt];
+		m->pos[m->high[0]] = HIGH_POS(0);
+		highSiftDown(m, 0);
+	}
+	return slot;
+}
+
+/*
+ * Restores max(low) <= min(high) after a single element changed value.
+ * Swapping the two tops is always enough in that case.
+ */
+static void exchangeTops(struct MedianBean *m) {
+	unsigned int l, h;
+
+	if (m->lowCnt == 0 || m->highCnt == 0) {
+		return;
+	}
+	l = m->low[0];
+	h = m->high[0];
+	if (m->data[l] <= m->data[h]) {
+		return;
+	}
+	m->low[0] = h;
+	m->pos[h] = 0;
+	m->high[0] = l;
+	m->pos[l] = HIGH_POS(0);
+	lowSiftDown(m, 0);
+	highSiftDown(m, 0);
+}
+
+int medianInit(struct MedianBean *m, unsigned int size) {
+	m->size = 0;
+	m->data = kvmalloc_array(size, sizeof(*m->data), GFP_KERNEL);
+	m->low = kvmalloc_array(size, sizeof(*m->low), GFP_KERNEL);
+	m->high = kvmalloc_array(size, sizeof(*m->high), GFP_KERNEL);
+	m->pos = kvmalloc_array(size, sizeof(*m->pos), GFP_KERNEL);
+	if (size == 0 || m->data == NULL || m->low == NULL || m->high == NULL
+			|| m->pos == NULL) {
+		medianFree(m);
+		return -ENOMEM;
+	}
+	m->size = size;
+	m->count = 0;
+	m->head = 0;
+	m->lowCnt = 0;
+	m->highCnt = 0;
+	return 0;
+}
+
+void medianFree(struct MedianBean *m) {
+	kvfree(m->data);
+	kvfree(m->low);
+	kvfree(m->high);
+	kvfree(m->pos);
+	m->data = NULL;
+	m->low = NULL;
+	m->high = NULL;
+	m->pos = NULL;
+	m->size = 0;
+}
+
+void medianFill(struct MedianBean *m, int32_t val) {
+	unsigned int i;
+
+	// all values are equal, any split is a valid pair of heaps
+	m->lowCnt = m->size / 2;
+	m->highCnt = m->size - m->lowCnt;
+	for (i = 0; i < m->size; i++) {
+		m->data[i] = val;
+		if (i < m->lowCnt) {
+			m->low[i] = i;
+			m->pos[i] = i;
+		} else {
+			m->high[i - m->lowCnt] = i;
+			m->pos[i] = HIGH_POS(i - m->lowCnt);
+		}
+	}
+	m->count = m->size;
+	m->head = 0;
+}
+
+void medianPush(struct MedianBean *m, int32_t val) {
+	unsigned int slot;
+	int p;
+
+	slot = m->head;
+	m->head = (m->head + 1) % m->size;
+	m->data[slot] = val;
+
+	if (m->count == m->size) {
+		// overwrite the oldest sample in place
+		p = m->pos[slot];
+		if (p >= 0) {
+			lowSiftUp(m, p);
+			lowSiftDown(m, m->pos[slot]);
+		} else {
+			highSiftUp(m, -(p + 1));
+			highSiftDown(m, -(m->pos[slot] + 1));
+		}
+		exchangeTops(m);
+		return;
+	}
+
+	m->count++;
+	if (m->lowCnt > 0 && val < m->data[m->low[0]]) {
+		lowInsert(m, slot);
+	} else {
+		highInsert(m, slot);
+	}
+	if (m->lowCnt > m->highCnt) {
+		highInsert(m, lowPopTop(m));
+	} else if (m->highCnt > m->lowCnt + 1) {
+		lowInsert(m, highPopTop(m));
+	}
+}
+
+/*
+ * Returns the element at index count/2 of the sorted window, i.e. the upper
+ * median when the window holds an even number of samples.
+ */
+int32_t medianGet(struct MedianBean *m) {
+	if (m->highCnt == 0) {
+		return 0;
+	}
+	return m->data[m->high[0]];
+}
@@ -0,0 +1,37 @@
+#ifndef _SL_MEDIAN_H
+#define _SL_MEDIAN_H
+
+#include <linux/types.h>
+
+/*
+ * Sliding-window median over the last 'size' samples.
+ *
+ * The window is kept split in two binary heaps: 'low' (max-heap) holds the
+ * smaller half, 'high' (min-heap) the larger half, with high holding at most
+ * one element more than low. Every ring slot knows its position in the heaps,
+ * so once the window is full the oldest sample is overwritten in place and
+ * re-sifted: push and get cost O(log size) and O(1) respectively.
+ */
+struct MedianBean {
+	unsigned int size;
+	unsigned int count;
+	unsigned int head;
+	int32_t *data;
+	unsigned int *low;
+	unsigned int *high;
+	int *pos;
+	unsigned int lowCnt;
+	unsigned int highCnt;
+};
+
+int medianInit(struct MedianBean *m, unsigned int size);
+
+void medianFree(struct MedianBean *m);
+
+void medianFill(struct MedianBean *m, int32_t val);
+
+void medianPush(struct MedianBean *m, int32_t val);
+
+int32_t medianGet(struct MedianBean *m);
+
+#endif
@@ -16,6 +16,11 @@
 #include "gpio/gpio.h"
 #include "wiegand/wiegand.h"
 #include "atecc/atecc.h"
+#include "median/median.h"
+#include "history/history.h"
+#include "rules/rules.h"
+#include "stats/stats.h"
+#include "uapi/exosensepi.h"
 #include "sensirion/sht4x/sht4x.h"
 #include "sensirion/sgp40/sgp40.h"
 #include "sensirion/sgp40_voc_index/sensirion_voc_algorithm.h"
@@ -25,19 +30,29 @@
 #include <linux/of.h>
 #include <linux/delay.h>
 #include <linux/i2c.h>
-#include <linux/kthread.h>
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/kfifo.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/semaphore.h>
+#include <linux/workqueue.h>
 #include <linux/proc_fs.h>
 #include <linux/uaccess.h>
 #include <linux/fs.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
-#include <linux/sort.h>
 #include <linux/version.h>
 #include <linux/platform_device.h>
 
-#define THA_READ_INTERVAL_MS 1000
-#define THA_DT_MEDIAN_PERIOD_MS 600000
-#define THA_DT_MEDIAN_SAMPLES (THA_DT_MEDIAN_PERIOD_MS / THA_READ_INTERVAL_MS)
+#define THA_VOC_INTERVAL_MS 1000
+#define THA_INTERVAL_MAX_SEC 3600
+#define THA_VOC_STATE_MIN_CYCLES (3 * 3600)
+#define THA_MAX_ATTEMPTS 3
+#define THA_LOCK_RETRY_USEC 100000
+#define THA_FIFO_SIZE 256
+#define THA_ERR_CODES 256
+#define THA_DT_MEDIAN_PERIOD_MAX_SEC (6 * 3600)
 
 #define RH_ADJ_MIN_TEMP_OFFSET (-100)
 #define RH_ADJ_MAX_TEMP_OFFSET (400)
@@ -62,6 +77,29 @@ static int temp_calib_b = -3000;
 module_param( temp_calib_b, int, S_IRUGO);
 MODULE_PARM_DESC(temp_calib_b, " Temperature calibration param B");
 
+static unsigned int dt_median_sec = 600;
+module_param( dt_median_sec, uint, S_IRUGO);
+MODULE_PARM_DESC(dt_median_sec, " Temperature variation median window in seconds");
+
+static int voc_state[2];
+static int voc_state_cnt = 0;
+module_param_array( voc_state, int, &voc_state_cnt, S_IRUGO);
+MODULE_PARM_DESC(voc_state, " VOC algorithm states to restore, as saved from tha/voc_state");
+
+static unsigned int i2c_lock_timeout_ms = 500;
+module_param( i2c_lock_timeout_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(i2c_lock_timeout_ms, " Max wait time for the I2C bus in ms");
+
+module_param_named( irq_storm_threshold, gpioIrqStormThreshold, uint,
+		S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_storm_threshold, " Edges per second above which a digital input or the PIR is sampled instead of using its IRQ, 0 to disable");
+
+static unsigned int sensors_interval_ms = 1000;
+
+static unsigned int sensors_max_age_ms = 1500;
+module_param( sensors_max_age_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sensors_max_age_ms, " Max age in ms of cached lux and system temperature values, 0 to always read the sensor");
+
 enum snd_time_weighting_mode {
 	FAST_WEIGHTING, SLOW_WEIGHTING, IMPULSE_WEIGHTING
 };
@@ -220,9 +258,36 @@ static ssize_t devAttrThaTh_show(struct device *dev,
 static ssize_t devAttrThaThv_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
+static ssize_t devAttrThaThvSeq_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
 static ssize_t devAttrThaTempOffset_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
+static ssize_t devAttrThaDtMedianSec_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrThaIntervalSec_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrThaVocState_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrThaVocState_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+static ssize_t devAttrThaIntervalSec_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+static ssize_t devAttrThaShtPrecision_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrThaShtPrecision_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+static ssize_t devAttrThaDtMedianSec_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
 static ssize_t devAttrThaTempOffset_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count);
 
@@ -232,12 +297,21 @@ static ssize_t devAttrLm75aU9_show(struct device *dev,
 static ssize_t devAttrLm75aU16_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
-static ssize_t devAttrLm75a_show(struct i2c_client *client, struct device *dev,
-		struct device_attribute *attr, char *buf);
-
 static ssize_t opt3001_show(struct device *dev, struct device_attribute *attr,
 		char *buf);
 
+static ssize_t devAttrIoState_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrIoState_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+static ssize_t devAttrIoRules_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+static ssize_t devAttrIoRules_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
 static ssize_t devAttrSndEvalPeriodLEQ_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
@@ -291,18 +365,175 @@ struct i2c_client *sgp40_i2c_client = NULL;
 struct i2c_client *lm75aU16_i2c_client = NULL;
 struct i2c_client *lm75aU9_i2c_client = NULL;
 struct i2c_client *opt3001_i2c_client = NULL;
-struct mutex exosensepi_i2c_mutex;
+static struct semaphore exosensepi_i2c_sem;
+static ktime_t exosensepi_i2c_lock_ts;
+
+struct I2cLockCounters {
+	atomic64_t acquisitions;
+	atomic64_t waits;
+	atomic64_t timeouts;
+};
+
+enum sensorCacheEnum {
+	SENSOR_CACHE_OPT3001 = 0,
+	SENSOR_CACHE_LM75A_U9,
+	SENSOR_CACHE_LM75A_U16,
+	SENSOR_CACHE_SIZE,
+};
+
+struct SensorCacheBean {
+	struct i2c_client **client;
+	int16_t (*read)(struct i2c_client *client, int32_t *val);
+	struct mutex lock;
+	seqlock_t seqlock;
+	int32_t value;
+	ktime_t ts;
+	bool valid;
+};
+
+static int16_t lm75aRead(struct i2c_client *client, int32_t *temp);
+
+static int16_t opt3001Read(struct i2c_client *client, int32_t *lux);
+
+static struct SensorCacheBean sensorCaches[SENSOR_CACHE_SIZE] = {
+	[SENSOR_CACHE_OPT3001] = {
+		.client = &opt3001_i2c_client,
+		.read = opt3001Read,
+	},
+	[SENSOR_CACHE_LM75A_U9] = {
+		.client = &lm75aU9_i2c_client,
+		.read = lm75aRead,
+	},
+	[SENSOR_CACHE_LM75A_U16] = {
+		.client = &lm75aU16_i2c_client,
+		.read = lm75aRead,
+	},
+};
+
+static struct delayed_work sensors_sampler_work;
+// guards sensors_sampler_running against scheduling the work
+static DEFINE_MUTEX(sensors_sampler_mutex);
+static bool sensors_sampler_running = false;
+
+static struct I2cLockCounters i2c_lock_counters;
+static struct StatsHistBean i2c_lock_wait_stats;
+static struct StatsHistBean i2c_lock_hold_stats;
 static VocAlgorithmParams voc_algorithm_params;
 
-static struct task_struct *tha_thread;
-static volatile uint16_t tha_ready = false;
-static volatile int32_t tha_t, tha_rh, tha_dt, tha_tCal, tha_rhCal,
-		tha_voc_index;
-static volatile uint16_t tha_sraw;
+enum thaStateEnum {
+	THA_STATE_START = 0,
+	THA_STATE_SHT_TRIGGER,
+	THA_STATE_SHT_READ,
+	THA_STATE_SGP_TRIGGER,
+	THA_STATE_SGP_READ,
+};
+
+struct ThaAcquisition {
+	int32_t t;
+	int32_t rh;
+	int32_t t9;
+	int32_t t16;
+	uint16_t sraw;
+};
+
+static struct workqueue_struct *tha_wq;
+static struct work_struct tha_work;
+static struct hrtimer tha_timer;
+static volatile bool tha_running = false;
+static enum thaStateEnum tha_state;
+static uint8_t tha_retries;
+static bool tha_cycle_sht;
+static unsigned int tha_sht_cycles;
+static unsigned int tha_interval_sec = 1;
+static volatile unsigned int tha_interval_sec_req = 1;
+static uint8_t tha_sht_repeatability = SHT4X_REPEATABILITY_HIGH;
+static volatile uint8_t tha_sht_repeatability_req = SHT4X_REPEATABILITY_HIGH;
+static int32_t tha_voc_index;
+static DEFINE_SPINLOCK(tha_voc_state_lock);
+static int32_t tha_voc_state[2];
+static int32_t tha_voc_state_req[2];
+static bool tha_voc_state_set_req = false;
+static bool tha_voc_state_valid = false;
+static unsigned int tha_voc_cycles = 0;
+static ktime_t tha_cycle_start;
+static struct ThaAcquisition tha_acq;
+
+enum thaStatEnum {
+	THA_STAT_LOCK_WAIT = 0,
+	THA_STAT_SHT,
+	THA_STAT_LM75,
+	THA_STAT_SGP,
+	THA_STAT_VOC,
+	THA_STAT_MEDIAN,
+	THA_STAT_CYCLE,
+	THA_STAT_SIZE,
+};
+
+static const char *tha_stat_names[THA_STAT_SIZE] = {
+	[THA_STAT_LOCK_WAIT] = "lock_wait",
+	[THA_STAT_SHT] = "sht4x",
+	[THA_STAT_LM75] = "lm75",
+	[THA_STAT_SGP] = "sgp40",
+	[THA_STAT_VOC] = "voc_process",
+	[THA_STAT_MEDIAN] = "dt_median",
+	[THA_STAT_CYCLE] = "cycle",
+};
+
+static const char *tha_state_names[] = {
+	[THA_STATE_START] = "start",
+	[THA_STATE_SHT_TRIGGER] = "sht_trigger",
+	[THA_STATE_SHT_READ] = "sht_read",
+	[THA_STATE_SGP_TRIGGER] = "sgp_trigger",
+	[THA_STATE_SGP_READ] = "sgp_read",
+};
+
+struct ThaCounters {
+	u64 cycles;
+	u64 samples;
+	u64 retries;
+	u64 failures;
+	u64 lockFailures;
+	u64 stateErrors[ARRAY_SIZE(tha_state_names)];
+	// index: -error code, last one for codes out of range
+	u64 errors[THA_ERR_CODES + 1];
+};
+
+static struct StatsHistBean tha_stats[THA_STAT_SIZE];
+static struct ThaCounters tha_counters;
+// serializes the counters between the acquisition and the stats file
+static DEFINE_MUTEX(tha_counters_mutex);
+static struct dentry *debugfs_dir = NULL;
+
+struct ThaReader {
+	struct list_head list;
+	// guards fifo, never held across copy_to_user()
+	spinlock_t lock;
+	DECLARE_KFIFO_PTR(fifo, struct exosensepi_tha_record);
+};
+
+static LIST_HEAD(tha_readers);
+static DEFINE_MUTEX(tha_readers_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(tha_readers_wq);
+static bool tha_misc_registered = false;
+static DEFINE_SEQLOCK(tha_sample_lock);
+static struct exosensepi_tha_record tha_sample;
+static uint32_t tha_seq = 0;
+
+struct HistoryReader {
+	struct mutex lock;
+	struct HistoryPoint *points;
+	unsigned int count;
+	unsigned int next;
+	unsigned int periodSec;
+};
+
+static const unsigned int history_period_sec[HISTORY_LEVELS] = { 1, 60, 3600 };
+static const unsigned int history_size[HISTORY_LEVELS] = { 600, 1440, 720 };
+static struct HistoryBean history[EXOSENSEPI_HISTORY_SERIES];
+static bool history_misc_registered = false;
 static volatile int tha_temp_offset = 0;
-static int32_t tha_dt_median_buff[THA_DT_MEDIAN_SAMPLES];
-static int32_t tha_dt_median_sort[THA_DT_MEDIAN_SAMPLES];
-static uint16_t tha_dt_idx = 0;
+static struct MedianBean tha_dt_median;
+static volatile unsigned int tha_dt_median_period_sec;
 
 static int32_t rhAdjLookup[] = { 2089, 2074, 2059, 2044, 2029, 2014, 1999, 1984,
 	1970, 1955, 1941, 1927, 1912, 1898, 1885, 1871, 1857, 1843, 1830, 1816,
@@ -372,19 +603,27 @@ enum ttlEnum {
 	TTL_SIZE,
 };
 
+static struct GpioPatternBean patternLed;
+static struct GpioPatternBean patternBuzz;
+static struct GpioPatternBean patternDO1;
+static struct GpioPatternBean patternTtl[TTL_SIZE];
+
 static struct GpioBean gpioLed = {
 	.name = "exosensepi_led",
 	.flags = GPIOD_OUT_LOW,
+	.pattern = &patternLed,
 };
 
 static struct GpioBean gpioBuzz = {
 	.name = "exosensepi_buzz",
 	.flags = GPIOD_OUT_LOW,
+	.pattern = &patternBuzz,
 };
 
 static struct GpioBean gpioDO1 = {
 	.name = "exosensepi_do1",
 	.flags = GPIOD_OUT_LOW,
+	.pattern = &patternDO1,
 };
 
 static struct DebouncedGpioBean gpioPir = {
@@ -409,22 +648,105 @@ static struct DebouncedGpioBean gpioDI[] = {
 	},
 };
 
-static struct GpioBean gpioTtl[] = {
+static struct GpioEventsDevBean gpioEventsDevs[] = {
+	{
+		.misc = {
+			.name = "exosensepi_di1",
+			.mode = 0440,
+		},
+		.deb = &gpioDI[DI1],
+	},
+	{
+		.misc = {
+			.name = "exosensepi_di2",
+			.mode = 0440,
+		},
+		.deb = &gpioDI[DI2],
+	},
+	{
+		.misc = {
+			.name = "exosensepi_pir",
+			.mode = 0440,
+		},
+		.deb = &gpioPir,
+	},
+	{ }
+};
+
+static struct DebouncedGpioBean gpioTtl[] = {
 	[TTL1] = {
-		.name = "exosensepi_ttl1",
+		.gpio = {
+			.name = "exosensepi_ttl1",
+			.pattern = &patternTtl[TTL1],
+		},
 	},
 	[TTL2] = {
-		.name = "exosensepi_ttl2",
+		.gpio = {
+			.name = "exosensepi_ttl2",
+			.pattern = &patternTtl[TTL2],
+		},
 	},
 };
 
+static struct DebouncedGpioBean *debouncedGpios[] = {
+	&gpioDI[DI1],
+	&gpioDI[DI2],
+	&gpioPir,
+	&gpioTtl[TTL1],
+	&gpioTtl[TTL2],
+	NULL,
+};
+
+static struct RulesBean ioRules = {
+	.lock = __SPIN_LOCK_UNLOCKED(ioRules.lock),
+};
+
+static void ioRulesChange(struct DebouncedGpioBean *d, int prev, int val) {
+	rulesEval(&ioRules, d, prev, val);
+}
+
+struct IoLineBean {
+	u32 bit;
+	struct GpioBean *gpio;
+};
+
+static struct IoLineBean ioLines[] = {
+	{ EXOSENSEPI_IO_DI1, &gpioDI[DI1].gpio },
+	{ EXOSENSEPI_IO_DI2, &gpioDI[DI2].gpio },
+	{ EXOSENSEPI_IO_PIR, &gpioPir.gpio },
+	{ EXOSENSEPI_IO_TTL1, &gpioTtl[TTL1].gpio },
+	{ EXOSENSEPI_IO_TTL2, &gpioTtl[TTL2].gpio },
+	{ EXOSENSEPI_IO_DO1, &gpioDO1 },
+	{ EXOSENSEPI_IO_LED, &gpioLed },
+	{ EXOSENSEPI_IO_BUZZ, &gpioBuzz },
+	{ 0, NULL },
+};
+
+static bool io_misc_registered = false;
+
+static struct GpioBean *wiegandOutputs[] = {
+	&gpioDO1,
+	&gpioBuzz,
+	&gpioLed,
+	NULL,
+};
+
 static struct WiegandBean w = {
 	.d0 = {
-		.gpio = &gpioTtl[TTL1],
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 	.d1 = {
-		.gpio = &gpioTtl[TTL2],
+		.gpio = &gpioTtl[TTL2].gpio,
+	},
+	.misc = {
+		.name = "exosensepi_wiegand",
+		.mode = 0440,
 	},
+	.allowMisc = {
+		.name = "exosensepi_wiegand_allow",
+		.mode = 0600,
+	},
+	.outputs = wiegandOutputs,
 };
 
 static struct DeviceAttrBean devAttrBeansLed[] = {
@@ -444,9 +766,9 @@ static struct DeviceAttrBean devAttrBeansLed[] = {
 		.devAttr = {
 			.attr = {
 				.name = "blink",
-				.mode = 0220,
+				.mode = 0660,
 			},
-			.show = NULL,
+			.show = devAttrGpioBlink_show,
 			.store = devAttrGpioBlink_store,
 		},
 		.gpio = &gpioLed,
@@ -472,9 +794,9 @@ static struct DeviceAttrBean devAttrBeansBuzzer[] = {
 		.devAttr = {
 			.attr = {
 				.name = "beep",
-				.mode = 0220,
+				.mode = 0660,
 			},
-			.show = NULL,
+			.show = devAttrGpioBlink_show,
 			.store = devAttrGpioBlink_store,
 		},
 		.gpio = &gpioBuzz,
@@ -496,6 +818,30 @@ static struct DeviceAttrBean devAttrBeansDigitalOut[] = {
 		.gpio = &gpioDO1,
 	},
 
+	{
+		.devAttr = {
+			.attr = {
+				.name = "do1_blink",
+				.mode = 0660,
+			},
+			.show = devAttrGpioBlink_show,
+			.store = devAttrGpioBlink_store,
+		},
+		.gpio = &gpioDO1,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "do1_pwm",
+				.mode = 0660,
+			},
+			.show = devAttrGpioPwm_show,
+			.store = devAttrGpioPwm_store,
+		},
+		.gpio = &gpioDO1,
+	},
+
 	{ }
 };
 
@@ -644,716 +990,2232 @@ static struct DeviceAttrBean devAttrBeansDigitalIn[] = {
 		.gpio = &gpioDI[DI2].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansDigitalIO[] = {
-	{
-		.devAttr = {
-			.attr = {
-				.name = "ttl1_mode",
-				.mode = 0660,
-			},
-			.show = devAttrGpioMode_show,
-			.store = devAttrGpioMode_store,
-		},
-		.gpio = &gpioTtl[TTL1],
-	},
-
 	{
 		.devAttr = {
 			.attr = {
-				.name = "ttl2_mode",
-				.mode = 0660,
+				.name = "di1_deb_on_cnt_reset",
+				.mode = 0440,
 			},
-			.show = devAttrGpioMode_show,
-			.store = devAttrGpioMode_store,
+			.show = devAttrGpioDebOnCntReset_show,
+			.store = NULL,
 		},
-		.gpio = &gpioTtl[TTL2],
+		.gpio = &gpioDI[DI1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "ttl1",
-				.mode = 0660,
+				.name = "di1_deb_off_cnt_reset",
+				.mode = 0440,
 			},
-			.show = devAttrGpio_show,
-			.store = devAttrGpio_store,
+			.show = devAttrGpioDebOffCntReset_show,
+			.store = NULL,
 		},
-		.gpio = &gpioTtl[TTL1],
+		.gpio = &gpioDI[DI1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "ttl2",
-				.mode = 0660,
+				.name = "di2_deb_on_cnt_reset",
+				.mode = 0440,
 			},
-			.show = devAttrGpio_show,
-			.store = devAttrGpio_store,
+			.show = devAttrGpioDebOnCntReset_show,
+			.store = NULL,
 		},
-		.gpio = &gpioTtl[TTL2],
+		.gpio = &gpioDI[DI2].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansPir[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "status",
+				.name = "di2_deb_off_cnt_reset",
 				.mode = 0440,
 			},
-			.show = devAttrGpioDeb_show,
+			.show = devAttrGpioDebOffCntReset_show,
 			.store = NULL,
 		},
-		.gpio = &gpioPir.gpio,
+		.gpio = &gpioDI[DI2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "cnt",
+				.name = "di1_pulse",
 				.mode = 0660,
 			},
-			.show = devAttrGpioDebOnCnt_show,
-			.store = devAttrPirOnCounter_store,
+			.show = devAttrGpioPulse_show,
+			.store = devAttrGpioPulse_store,
 		},
-		.gpio = &gpioPir.gpio,
+		.gpio = &gpioDI[DI1].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansTha[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "temp_rh_voc",
-				.mode = 0440,
+				.name = "di1_pulse_gate_sec",
+				.mode = 0660,
 			},
-			.show = devAttrThaThv_show,
-			.store = NULL,
+			.show = devAttrGpioPulseGate_show,
+			.store = devAttrGpioPulseGate_store,
 		},
+		.gpio = &gpioDI[DI1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "temp_rh",
-				.mode = 0440,
+				.name = "di2_pulse",
+				.mode = 0660,
 			},
-			.show = devAttrThaTh_show,
-			.store = NULL,
+			.show = devAttrGpioPulse_show,
+			.store = devAttrGpioPulse_store,
 		},
+		.gpio = &gpioDI[DI2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "temp_offset",
+				.name = "di2_pulse_gate_sec",
 				.mode = 0660,
 			},
-			.show = devAttrThaTempOffset_show,
-			.store = devAttrThaTempOffset_store,
+			.show = devAttrGpioPulseGate_show,
+			.store = devAttrGpioPulseGate_store,
 		},
+		.gpio = &gpioDI[DI2].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansSysTemp[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "t2",
+				.name = "di1_pulse_cnt_reset",
 				.mode = 0440,
 			},
-			.show = devAttrLm75aU9_show,
+			.show = devAttrGpioPulseCntReset_show,
 			.store = NULL,
 		},
+		.gpio = &gpioDI[DI1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "t1",
+				.name = "di2_pulse_cnt_reset",
 				.mode = 0440,
 			},
-			.show = devAttrLm75aU16_show,
+			.show = devAttrGpioPulseCntReset_show,
 			.store = NULL,
 		},
+		.gpio = &gpioDI[DI2].gpio,
 	},
 
 	{ }
 };
 
-static struct DeviceAttrBean devAttrBeansLux[] = {
+static struct DeviceAttrBean devAttrBeansDigitalIO[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "lux",
-				.mode = 0440,
+				.name = "ttl1_mode",
+				.mode = 0660,
 			},
-			.show = opt3001_show,
-			.store = NULL,
+			.show = devAttrGpioDebMode_show,
+			.store = devAttrGpioDebMode_store,
 		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansAtecc[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "serial_num",
-				.mode = 0440,
+				.name = "ttl2_mode",
+				.mode = 0660,
 			},
-			.show = devAttrAteccSerial_show,
-			.store = NULL,
+			.show = devAttrGpioDebMode_show,
+			.store = devAttrGpioDebMode_store,
 		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
-	{ }
-};
-
-static struct DeviceAttrBean devAttrBeansSound[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "leq_period",
-				.mode = 0640,
+				.name = "ttl1",
+				.mode = 0660,
 			},
-			.show = devAttrSndEvalPeriodLEQ_show,
-			.store = devAttrSndEvalPeriodLEQ_store,
+			.show = devAttrGpio_show,
+			.store = devAttrGpio_store,
 		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "leq_interval",
-				.mode = 0640,
+				.name = "ttl1_pwm",
+				.mode = 0660,
 			},
-			.show = devAttrSndEvalIntervalLEQ_show,
-			.store = devAttrSndEvalIntervalLEQ_store,
+			.show = devAttrGpioPwm_show,
+			.store = devAttrGpioPwm_store,
 		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "leq_period_bands",
-				.mode = 0640,
+				.name = "ttl2",
+				.mode = 0660,
 			},
-			.show = devAttrSndEvalPeriodBandsLEQ_show,
-			.store = devAttrSndEvalPeriodBandsLEQ_store,
+			.show = devAttrGpio_show,
+			.store = devAttrGpio_store,
 		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "weight_time",
+				.name = "ttl2_pwm",
 				.mode = 0660,
 			},
-			.show = devAttrSndEvalTimeWeight_show,
-			.store = devAttrSndEvalTimeWeight_store,
+			.show = devAttrGpioPwm_show,
+			.store = devAttrGpioPwm_store,
 		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "weight_freq",
-				.mode = 0660,
+				.name = "ttl1_deb",
+				.mode = 0440,
 			},
-			.show = devAttrSndEvalFreqWeight_show,
-			.store = devAttrSndEvalFreqWeight_store,
+			.show = devAttrGpioDeb_show,
+			.store = NULL,
 		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "weight_freq_bands",
-				.mode = 0660,
+				.name = "ttl2_deb",
+				.mode = 0440,
 			},
-			.show = devAttrSndEvalFreqBandsType_show,
-			.store = devAttrSndEvalFreqBandsType_store,
-		},
+			.show = devAttrGpioDeb_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "interval_sec",
+				.name = "ttl1_deb_on_ms",
 				.mode = 0660,
 			},
-			.show = devAttrSndEvalIntervalSec_show,
-			.store = devAttrSndEvalIntervalSec_store,
+			.show = devAttrGpioDebMsOn_show,
+			.store = devAttrGpioDebMsOn_store,
 		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "enabled",
+				.name = "ttl2_deb_on_ms",
 				.mode = 0660,
 			},
-			.show = devAttrSndEvalEnableUtility_show,
-			.store = devAttrSndEvalEnableUtility_store,
+			.show = devAttrGpioDebMsOn_show,
+			.store = devAttrGpioDebMsOn_store,
 		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
-	{ }
-};
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl1_deb_off_ms",
+				.mode = 0660,
+			},
+			.show = devAttrGpioDebMsOff_show,
+			.store = devAttrGpioDebMsOff_store,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
+	},
 
-static struct DeviceAttrBean devAttrBeansWiegand[] = {
 	{
 		.devAttr = {
 			.attr = {
-				.name = "enabled",
+				.name = "ttl2_deb_off_ms",
 				.mode = 0660,
 			},
-			.show = devAttrWiegandEnabled_show,
-			.store = devAttrWiegandEnabled_store,
-		}
+			.show = devAttrGpioDebMsOff_show,
+			.store = devAttrGpioDebMsOff_store,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "data",
+				.name = "ttl1_deb_on_cnt",
 				.mode = 0440,
 			},
-			.show = devAttrWiegandData_show,
+			.show = devAttrGpioDebOnCnt_show,
 			.store = NULL,
-		}
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "noise",
+				.name = "ttl2_deb_on_cnt",
 				.mode = 0440,
 			},
-			.show = devAttrWiegandNoise_show,
+			.show = devAttrGpioDebOnCnt_show,
 			.store = NULL,
-		}
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "pulse_itvl_min",
+				.name = "ttl1_deb_off_cnt",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOffCnt_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl2_deb_off_cnt",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOffCnt_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl1_deb_on_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOnCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl1_deb_off_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOffCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl2_deb_on_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOnCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl2_deb_off_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOffCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl1_pulse",
 				.mode = 0660,
 			},
-			.show = devAttrWiegandPulseIntervalMin_show,
-			.store = devAttrWiegandPulseIntervalMin_store,
-		}
+			.show = devAttrGpioPulse_show,
+			.store = devAttrGpioPulse_store,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "pulse_itvl_max",
+				.name = "ttl2_pulse",
 				.mode = 0660,
 			},
-			.show = devAttrWiegandPulseIntervalMax_show,
-			.store = devAttrWiegandPulseIntervalMax_store,
-		}
+			.show = devAttrGpioPulse_show,
+			.store = devAttrGpioPulse_store,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "pulse_width_min",
+				.name = "ttl1_pulse_gate_sec",
 				.mode = 0660,
 			},
-			.show = devAttrWiegandPulseWidthMin_show,
-			.store = devAttrWiegandPulseWidthMin_store,
-		}
+			.show = devAttrGpioPulseGate_show,
+			.store = devAttrGpioPulseGate_store,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
 	},
 
 	{
 		.devAttr = {
 			.attr = {
-				.name = "pulse_width_max",
+				.name = "ttl2_pulse_gate_sec",
 				.mode = 0660,
 			},
-			.show = devAttrWiegandPulseWidthMax_show,
-			.store = devAttrWiegandPulseWidthMax_store,
-		}
+			.show = devAttrGpioPulseGate_show,
+			.store = devAttrGpioPulseGate_store,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
-	{ }
-};
+	{
+		.devAttr = {
+			.attr = {
+				.name = "ttl1_pulse_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioPulseCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL1].gpio,
+	},
 
-static struct DeviceBean devices[] = {
 	{
-		.name = "led",
-		.devAttrBeans = devAttrBeansLed,
+		.devAttr = {
+			.attr = {
+				.name = "ttl2_pulse_cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioPulseCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioTtl[TTL2].gpio,
 	},
 
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansPir[] = {
 	{
-		.name = "buzzer",
-		.devAttrBeans = devAttrBeansBuzzer,
+		.devAttr = {
+			.attr = {
+				.name = "status",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDeb_show,
+			.store = NULL,
+		},
+		.gpio = &gpioPir.gpio,
 	},
 
 	{
-		.name = "digital_out",
-		.devAttrBeans = devAttrBeansDigitalOut,
+		.devAttr = {
+			.attr = {
+				.name = "cnt",
+				.mode = 0660,
+			},
+			.show = devAttrGpioDebOnCnt_show,
+			.store = devAttrPirOnCounter_store,
+		},
+		.gpio = &gpioPir.gpio,
 	},
 
 	{
-		.name = "digital_in",
-		.devAttrBeans = devAttrBeansDigitalIn,
+		.devAttr = {
+			.attr = {
+				.name = "cnt_reset",
+				.mode = 0440,
+			},
+			.show = devAttrGpioDebOnCntReset_show,
+			.store = NULL,
+		},
+		.gpio = &gpioPir.gpio,
 	},
 
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansTha[] = {
 	{
-		.name = "digital_io",
-		.devAttrBeans = devAttrBeansDigitalIO,
+		.devAttr = {
+			.attr = {
+				.name = "temp_rh_voc",
+				.mode = 0440,
+			},
+			.show = devAttrThaThv_show,
+			.store = NULL,
+		},
 	},
 
 	{
-		.name = "tha",
-		.devAttrBeans = devAttrBeansTha,
+		.devAttr = {
+			.attr = {
+				.name = "temp_rh_voc_seq",
+				.mode = 0440,
+			},
+			.show = devAttrThaThvSeq_show,
+			.store = NULL,
+		},
 	},
 
 	{
-		.name = "sys_temp",
-		.devAttrBeans = devAttrBeansSysTemp,
+		.devAttr = {
+			.attr = {
+				.name = "temp_rh",
+				.mode = 0440,
+			},
+			.show = devAttrThaTh_show,
+			.store = NULL,
+		},
 	},
 
 	{
-		.name = "lux",
-		.devAttrBeans = devAttrBeansLux,
+		.devAttr = {
+			.attr = {
+				.name = "temp_offset",
+				.mode = 0660,
+			},
+			.show = devAttrThaTempOffset_show,
+			.store = devAttrThaTempOffset_store,
+		},
 	},
 
 	{
-		.name = "wiegand",
-		.devAttrBeans = devAttrBeansWiegand,
+		.devAttr = {
+			.attr = {
+				.name = "dt_median_sec",
+				.mode = 0660,
+			},
+			.show = devAttrThaDtMedianSec_show,
+			.store = devAttrThaDtMedianSec_store,
+		},
 	},
 
 	{
-		.name = "pir",
-		.devAttrBeans = devAttrBeansPir,
+		.devAttr = {
+			.attr = {
+				.name = "interval_sec",
+				.mode = 0660,
+			},
+			.show = devAttrThaIntervalSec_show,
+			.store = devAttrThaIntervalSec_store,
+		},
 	},
 
 	{
-		.name = "sec_elem",
-		.devAttrBeans = devAttrBeansAtecc,
+		.devAttr = {
+			.attr = {
+				.name = "temp_rh_precision",
+				.mode = 0660,
+			},
+			.show = devAttrThaShtPrecision_show,
+			.store = devAttrThaShtPrecision_store,
+		},
 	},
 
 	{
-		.name = "sound_eval",
-		.devAttrBeans = devAttrBeansSound,
+		.devAttr = {
+			.attr = {
+				.name = "voc_state",
+				.mode = 0660,
+			},
+			.show = devAttrThaVocState_show,
+			.store = devAttrThaVocState_store,
+		},
 	},
 
 	{ }
 };
 
-static int write_settings_to_proc_buffer(void) {
-	char *tmp = kzalloc(PROCFS_MAX_SIZE, GFP_KERNEL);
-	if (tmp != NULL) {
-		sprintf(tmp, "%s%d%s%d%s%lu%s%d%s%d%s",
-				default_settings[0], soundEval.setting_time_weight,
-				default_settings[1], soundEval.setting_freq_weight,
-				default_settings[2], soundEval.setting_interval,
-				default_settings[3], soundEval.setting_freq_bands_type,
-				default_settings[4], !soundEval.setting_enable_utility,
-				default_settings[5]);
-		memcpy(&procfs_buffer, tmp, strlen(tmp));
-		procfs_buffer_size = strlen(tmp);
-		kfree(tmp);
+static struct DeviceAttrBean devAttrBeansSysTemp[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "t2",
+				.mode = 0440,
+			},
+			.show = devAttrLm75aU9_show,
+			.store = NULL,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "t1",
+				.mode = 0440,
+			},
+			.show = devAttrLm75aU16_show,
+			.store = NULL,
+		},
+	},
+
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansLux[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "lux",
+				.mode = 0440,
+			},
+			.show = opt3001_show,
+			.store = NULL,
+		},
+	},
+
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansAtecc[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "serial_num",
+				.mode = 0440,
+			},
+			.show = devAttrAteccSerial_show,
+			.store = NULL,
+		},
+	},
+
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansSound[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "leq_period",
+				.mode = 0640,
+			},
+			.show = devAttrSndEvalPeriodLEQ_show,
+			.store = devAttrSndEvalPeriodLEQ_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "leq_interval",
+				.mode = 0640,
+			},
+			.show = devAttrSndEvalIntervalLEQ_show,
+			.store = devAttrSndEvalIntervalLEQ_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "leq_period_bands",
+				.mode = 0640,
+			},
+			.show = devAttrSndEvalPeriodBandsLEQ_show,
+			.store = devAttrSndEvalPeriodBandsLEQ_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "weight_time",
+				.mode = 0660,
+			},
+			.show = devAttrSndEvalTimeWeight_show,
+			.store = devAttrSndEvalTimeWeight_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "weight_freq",
+				.mode = 0660,
+			},
+			.show = devAttrSndEvalFreqWeight_show,
+			.store = devAttrSndEvalFreqWeight_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "weight_freq_bands",
+				.mode = 0660,
+			},
+			.show = devAttrSndEvalFreqBandsType_show,
+			.store = devAttrSndEvalFreqBandsType_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "interval_sec",
+				.mode = 0660,
+			},
+			.show = devAttrSndEvalIntervalSec_show,
+			.store = devAttrSndEvalIntervalSec_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "enabled",
+				.mode = 0660,
+			},
+			.show = devAttrSndEvalEnableUtility_show,
+			.store = devAttrSndEvalEnableUtility_store,
+		},
+	},
+
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansWiegand[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "enabled",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandEnabled_show,
+			.store = devAttrWiegandEnabled_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "data",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandData_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "data_hex",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandDataHex_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "data_bin",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandDataBin_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "card",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandCard_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "formats",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandFormats_show,
+			.store = devAttrWiegandFormats_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "allow_count",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandAllowCount_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "grant_action",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandGrantAction_show,
+			.store = devAttrWiegandGrantAction_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "deny_action",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandDenyAction_show,
+			.store = devAttrWiegandDenyAction_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "keypad",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandKeypad_show,
+			.store = devAttrWiegandKeypad_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "keypad_timeout",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandKeypadTimeout_show,
+			.store = devAttrWiegandKeypadTimeout_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "keypad_max_len",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandKeypadMaxLen_show,
+			.store = devAttrWiegandKeypadMaxLen_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "pin",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandPin_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "noise",
+				.mode = 0440,
+			},
+			.show = devAttrWiegandNoise_show,
+			.store = NULL,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "pulse_itvl_min",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandPulseIntervalMin_show,
+			.store = devAttrWiegandPulseIntervalMin_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "pulse_itvl_max",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandPulseIntervalMax_show,
+			.store = devAttrWiegandPulseIntervalMax_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "pulse_width_min",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandPulseWidthMin_show,
+			.store = devAttrWiegandPulseWidthMin_store,
+		}
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "pulse_width_max",
+				.mode = 0660,
+			},
+			.show = devAttrWiegandPulseWidthMax_show,
+			.store = devAttrWiegandPulseWidthMax_store,
+		}
+	},
+
+	{ }
+};
+
+static struct DeviceAttrBean devAttrBeansIo[] = {
+	{
+		.devAttr = {
+			.attr = {
+				.name = "state",
+				.mode = 0660,
+			},
+			.show = devAttrIoState_show,
+			.store = devAttrIoState_store,
+		},
+	},
+
+	{
+		.devAttr = {
+			.attr = {
+				.name = "rules",
+				.mode = 0660,
+			},
+			.show = devAttrIoRules_show,
+			.store = devAttrIoRules_store,
+		},
+	},
+
+	{ }
+};
+
+static struct DeviceBean devices[] = {
+	{
+		.name = "led",
+		.devAttrBeans = devAttrBeansLed,
+	},
+
+	{
+		.name = "buzzer",
+		.devAttrBeans = devAttrBeansBuzzer,
+	},
+
+	{
+		.name = "digital_out",
+		.devAttrBeans = devAttrBeansDigitalOut,
+	},
+
+	{
+		.name = "digital_in",
+		.devAttrBeans = devAttrBeansDigitalIn,
+	},
+
+	{
+		.name = "digital_io",
+		.devAttrBeans = devAttrBeansDigitalIO,
+	},
+
+	{
+		.name = "tha",
+		.devAttrBeans = devAttrBeansTha,
+	},
+
+	{
+		.name = "sys_temp",
+		.devAttrBeans = devAttrBeansSysTemp,
+	},
+
+	{
+		.name = "lux",
+		.devAttrBeans = devAttrBeansLux,
+	},
+
+	{
+		.name = "wiegand",
+		.devAttrBeans = devAttrBeansWiegand,
+	},
+
+	{
+		.name = "pir",
+		.devAttrBeans = devAttrBeansPir,
+	},
+
+	{
+		.name = "sec_elem",
+		.devAttrBeans = devAttrBeansAtecc,
+	},
+
+	{
+		.name = "sound_eval",
+		.devAttrBeans = devAttrBeansSound,
+	},
+
+	{
+		.name = "io",
+		.devAttrBeans = devAttrBeansIo,
+	},
+
+	{ }
+};
+
+static int write_settings_to_proc_buffer(void) {
+	char *tmp = kzalloc(PROCFS_MAX_SIZE, GFP_KERNEL);
+	if (tmp != NULL) {
+		sprintf(tmp, "%s%d%s%d%s%lu%s%d%s%d%s",
+				default_settings[0], soundEval.setting_time_weight,
+				default_settings[1], soundEval.setting_freq_weight,
+				default_settings[2], soundEval.setting_interval,
+				default_settings[3], soundEval.setting_freq_bands_type,
+				default_settings[4], !soundEval.setting_enable_utility,
+				default_settings[5]);
+		memcpy(&procfs_buffer, tmp, strlen(tmp));
+		procfs_buffer_size = strlen(tmp);
+		kfree(tmp);
+
+		return 0;
+	} else {
+		pr_alert(LOG_TAG "proc setting file write failed\n");
+		return -ENOMEM;
+	}
+}
+
+struct GpioBean* gpioGetBean(struct device *dev, struct device_attribute *attr) {
+	struct DeviceAttrBean *dab;
+	dab = container_of(attr, struct DeviceAttrBean, devAttr);
+	if (dab == NULL) {
+		return NULL;
+	}
+	return dab->gpio;
+}
+
+struct WiegandBean* wiegandGetBean(struct device *dev,
+		struct device_attribute *attr) {
+	return &w;
+}
+
+static ssize_t devAttrPirOnCounter_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	unsigned long val;
+
+	int ret = kstrtoul(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val != 0) {
+		return -EINVAL;
+	}
+
+	atomic64_set(&gpioPir.onCnt, 0);
+
+	return count;
+}
+
+/*
+ * Takes exclusive access to the I2C bus, waiting up to i2c_lock_timeout_ms.
+ * Waiters are served in FIFO order.
+ */
+static bool exosensepi_i2c_lock(void) {
+	ktime_t ts;
+	int ret;
+
+	if (down_trylock(&exosensepi_i2c_sem)) {
+		atomic64_inc(&i2c_lock_counters.waits);
+		ts = ktime_get();
+		ret = down_timeout(&exosensepi_i2c_sem,
+				msecs_to_jiffies(i2c_lock_timeout_ms));
+		statsHistAdd(&i2c_lock_wait_stats, ktime_us_delta(ktime_get(), ts));
+		if (ret) {
+			atomic64_inc(&i2c_lock_counters.timeouts);
+			return false;
+		}
+	}
+	atomic64_inc(&i2c_lock_counters.acquisitions);
+	exosensepi_i2c_lock_ts = ktime_get();
+	return true;
+}
+
+static void exosensepi_i2c_unlock(void) {
+	statsHistAdd(&i2c_lock_hold_stats,
+			ktime_us_delta(ktime_get(), exosensepi_i2c_lock_ts));
+	up(&exosensepi_i2c_sem);
+}
+
+static int i2cLockStatsShow(struct seq_file *m, void *v) {
+	seq_printf(m, "acquisitions=%lld waits=%lld timeouts=%lld\n",
+			atomic64_read(&i2c_lock_counters.acquisitions),
+			atomic64_read(&i2c_lock_counters.waits),
+			atomic64_read(&i2c_lock_counters.timeouts));
+	statsHistShow(m, &i2c_lock_wait_stats, "us");
+	statsHistShow(m, &i2c_lock_hold_stats, "us");
+	return 0;
+}
+
+static int i2cLockStatsOpen(struct inode *inode, struct file *file) {
+	return single_open(file, i2cLockStatsShow, NULL);
+}
+
+static ssize_t i2cLockStatsWrite(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	// any write resets the statistics
+	atomic64_set(&i2c_lock_counters.acquisitions, 0);
+	atomic64_set(&i2c_lock_counters.waits, 0);
+	atomic64_set(&i2c_lock_counters.timeouts, 0);
+	statsHistReset(&i2c_lock_wait_stats);
+	statsHistReset(&i2c_lock_hold_stats);
+	return count;
+}
+
+static const struct file_operations i2c_lock_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = i2cLockStatsOpen,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = i2cLockStatsWrite,
+};
+
+static int gpioStatsShow(struct seq_file *m, void *v) {
+	int i;
+
+	for (i = 0; debouncedGpios[i] != NULL; i++) {
+		if (debouncedGpios[i]->irqRequested) {
+			gpioDebounceStatsShow(m, debouncedGpios[i]);
+		}
+	}
+	return 0;
+}
+
+static int gpioStatsOpen(struct inode *inode, struct file *file) {
+	return single_open(file, gpioStatsShow, NULL);
+}
+
+static const struct file_operations gpio_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = gpioStatsOpen,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct GpioBean *patternGpios[] = {
+	&gpioLed,
+	&gpioBuzz,
+	&gpioDO1,
+	&gpioTtl[TTL1].gpio,
+	&gpioTtl[TTL2].gpio,
+	NULL,
+};
+
+static int patternStatsShow(struct seq_file *m, void *v) {
+	int i;
+
+	for (i = 0; patternGpios[i] != NULL; i++) {
+		gpioPatternStatsShow(m, patternGpios[i]);
+	}
+	return 0;
+}
+
+static int patternStatsOpen(struct inode *inode, struct file *file) {
+	return single_open(file, patternStatsShow, NULL);
+}
+
+static ssize_t patternStatsWrite(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	int i;
+
+	// any write resets the statistics
+	for (i = 0; patternGpios[i] != NULL; i++) {
+		gpioPatternStatsReset(patternGpios[i]);
+	}
+	return count;
+}
+
+static const struct file_operations pattern_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = patternStatsOpen,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = patternStatsWrite,
+};
+
+static int captureShow(struct seq_file *m, void *v) {
+	gpioCaptureShow(m);
+	return 0;
+}
+
+static int captureOpen(struct inode *inode, struct file *file) {
+	return single_open(file, captureShow, NULL);
+}
+
+/*
+ * "<input> <max_edges> <max_ms>" starts a capture of the given input
+ * (di1, di2, pir, ttl1, ttl2), "stop" ends it.
+ */
+static ssize_t captureWrite(struct file *file, const char __user *ubuf,
+		size_t count, loff_t *ppos) {
+	char buf[32], input[8];
+	unsigned int maxEdges, maxMs;
+	const char *name;
+	int i, ret;
+
+	if (count >= sizeof(buf)) {
+		return -EINVAL;
+	}
+	if (copy_from_user(buf, ubuf, count)) {
+		return -EFAULT;
+	}
+	buf[count] = '\0';
+
+	if (sysfs_streq(buf, "stop")) {
+		gpioCaptureStop();
+		return count;
+	}
+	if (sscanf(buf, "%7s %u %u", input, &maxEdges, &maxMs) != 3) {
+		return -EINVAL;
+	}
+	for (i = 0; debouncedGpios[i] != NULL; i++) {
+		name = debouncedGpios[i]->gpio.name;
+		if (strcmp(name + strlen("exosensepi_"), input) == 0) {
+			ret = gpioCaptureStart(debouncedGpios[i], maxEdges, maxMs);
+			return ret < 0 ? ret : count;
+		}
+	}
+	return -EINVAL;
+}
+
+static const struct file_operations capture_fops = {
+	.owner = THIS_MODULE,
+	.open = captureOpen,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = captureWrite,
+};
+
+static ssize_t captureDataRead(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	return gpioCaptureRead(buf, count, ppos);
+}
+
+static const struct file_operations capture_data_fops = {
+	.owner = THIS_MODULE,
+	.read = captureDataRead,
+	.llseek = default_llseek,
+};
+
+static void i2cLockInit(void) {
+	sema_init(&exosensepi_i2c_sem, 1);
+	statsHistInit(&i2c_lock_wait_stats, "wait");
+	statsHistInit(&i2c_lock_hold_stats, "hold");
+	debugfs_create_file("i2c_stats", 0600, debugfs_dir, NULL,
+			&i2c_lock_stats_fops);
+}
+
+static struct i2c_client* sensirion_i2c_client_get(uint8_t address) {
+	if (sht40_i2c_client != NULL && sht40_i2c_client->addr == address) {
+		return sht40_i2c_client;
+	}
+	if (sgp40_i2c_client != NULL && sgp40_i2c_client->addr == address) {
+		return sgp40_i2c_client;
+	}
+	return NULL;
+}
+
+/**
+ * Execute one write transaction on the I2C bus, sending a given number of
+ * bytes. The bytes in the supplied buffer must be sent to the given address. If
+ * the slave device does not acknowledge any of the bytes, an error shall be
+ * returned.
+ *
+ * @param address 7-bit I2C address to write to
+ * @param data    pointer to the buffer containing the data to write
+ * @param count   number of bytes to read from the buffer and send over I2C
+ * @returns 0 on success, error code otherwise
+ */
+int8_t sensirion_i2c_write(uint8_t address, const uint8_t *data,
+		uint16_t count) {
+	struct i2c_client *client;
+
+	client = sensirion_i2c_client_get(address);
+	if (client == NULL) {
+		return -ENODEV;
+	}
+	if (i2c_master_send(client, data, count) != count) {
+		return -EIO;
+	}
+	return 0;
+}
+
+/**
+ * Execute one read transaction on the I2C bus, reading a given number of bytes.
+ * If the device does not acknowledge the read command, an error shall be
+ * returned.
+ *
+ * @param address 7-bit I2C address to read from
+ * @param data    pointer to the buffer where the data is to be stored
+ * @param count   number of bytes to read from I2C and store in the buffer
+ * @returns 0 on success, error code otherwise
+ */
+int8_t sensirion_i2c_read(uint8_t address, uint8_t *data, uint16_t count) {
+	struct i2c_client *client;
+
+	client = sensirion_i2c_client_get(address);
+	if (client == NULL) {
+		return -ENODEV;
+	}
+	if (i2c_master_recv(client, data, count) != count) {
+		return -EIO;
+	}
+	return 0;
+}
+
+/**
+ * Sleep for a given number of microseconds. The function should delay the
+ * execution for at least the given time, but may also sleep longer.
+ *
+ * Despite the unit, a <10 millisecond precision is sufficient.
+ *
+ * @param useconds the sleep time in microseconds
+ */
+void sensirion_sleep_usec(uint32_t useconds) {
+	msleep((useconds / 1000) + 1);
+}
+
+static int16_t lm75aRead(struct i2c_client *client, int32_t *temp) {
+	if (client == NULL) {
+		return -ENODEV;
+	}
+
+	*temp = i2c_smbus_read_word_data(client, 0);
+
+	if (*temp < 0) {
+		return *temp;
+	}
+
+	*temp = ((*temp & 0xff) << 8) + ((*temp >> 8) & 0xe0);
+	*temp = ((int16_t) * temp) * 100 / 256;
+
+	return 0;
+}
+
+static unsigned int thaDtMedianSamples(unsigned int periodSec) {
+	unsigned int samples;
+	samples = periodSec / tha_interval_sec;
+	return samples > 0 ? samples : 1;
+}
+
+/*
+ * Applies a window length or sampling interval change requested via sysfs.
+ * Runs in the THA work so that the median is never resized while in use. On
+ * allocation failure the current window is kept.
+ */
+static void thaDtMedianResize(void) {
+	struct MedianBean m;
+	unsigned int samples;
+
+	samples = thaDtMedianSamples(tha_dt_median_period_sec);
+	if (samples == tha_dt_median.size) {
+		return;
+	}
+
+	if (medianInit(&m, samples)) {
+		pr_err(LOG_TAG "dt median resize to %u samples failed\n", samples);
+		tha_dt_median_period_sec = tha_dt_median.size * tha_interval_sec;
+		return;
+	}
+
+	medianFill(&m, medianGet(&tha_dt_median));
+	medianFree(&tha_dt_median);
+	tha_dt_median = m;
+}
+
+static ktime_t thaStatAdd(enum thaStatEnum stat, ktime_t since) {
+	ktime_t now;
+	s64 delta;
+
+	now = ktime_get();
+	delta = ktime_us_delta(now, since);
+	statsHistAdd(&tha_stats[stat], delta > 0 ? delta : 0);
+	return now;
+}
+
+static void thaCount(u64 *cnt) {
+	mutex_lock(&tha_counters_mutex);
+	(*cnt)++;
+	mutex_unlock(&tha_counters_mutex);
+}
+
+static void thaStatError(int16_t ret) {
+	unsigned int code = -ret;
+
+	if (code >= THA_ERR_CODES) {
+		code = THA_ERR_CODES;
+	}
+	mutex_lock(&tha_counters_mutex);
+	tha_counters.errors[code]++;
+	tha_counters.stateErrors[tha_state]++;
+	mutex_unlock(&tha_counters_mutex);
+}
+
+static void thaCalibrate(int32_t *t, int32_t *rh, int32_t t9, int32_t t16,
+		int32_t *dt, int32_t *tCal, int32_t *rhCal) {
+	int rhIdx;
+	int32_t tOff;
+	ktime_t ts;
+
+	*dt = t16 - t9;
+	if (*dt < 0) {
+		*dt = 0;
+	}
+
+	ts = ktime_get();
+	if (tha_seq != 0) {
+		medianPush(&tha_dt_median, *dt);
+	} else {
+		medianFill(&tha_dt_median, *dt);
+	}
+
+	*dt = medianGet(&tha_dt_median);
+	thaStatAdd(THA_STAT_MEDIAN, ts);
+
+	// t [°C/1000]
+	// rh [%/1000]
+	// t9,t16,dt [°C/100]
+	// tha_temp_offset [°C/100]
+	// temp_calib_b [°C/1000]
+	// temp_calib_m [1/1000]
+
+	*tCal = (
+			(100 * (*t)) // 100 * t [°C/1000] = t [°C/100000]
+			+ (temp_calib_m * (*dt)) // temp_calib_m [1/1000] * dt [°C/100] = temp_calib_m * 1000 * dt [°C/100] = temp_calib_m * dt [°C/100000]
+					+ (100 * temp_calib_b) // 100 * temp_calib_b [°C/1000] = temp_calib_b [°C/100000]
+			);// [°C/100000]
+	*tCal = DIV_ROUND_CLOSEST(*tCal, 1000) + tha_temp_offset; // [°C/100]
+
+	*t /= 10; // [°C/100]
+	*rh /= 10; // [%/100]
+
+	tOff = (*t) - (*tCal); // [°C/100]
+	tOff = DIV_ROUND_CLOSEST(tOff, 10); // [°C/10]
+
+	if (tOff < RH_ADJ_MIN_TEMP_OFFSET) {
+		tOff = RH_ADJ_MIN_TEMP_OFFSET;
+	} else if (tOff > RH_ADJ_MAX_TEMP_OFFSET - 1) {
+		tOff = RH_ADJ_MAX_TEMP_OFFSET - 1;
+	}
+	rhIdx = tOff - RH_ADJ_MIN_TEMP_OFFSET;
+	*rhCal = (*rh) * RH_ADJ_FACTOR / rhAdjLookup[rhIdx];
+	if (*rhCal > 10000) {
+		*rhCal = 10000;
+	} else if (*rhCal < 0) {
+		*rhCal = 0;
+	}
+}
 
-		return 0;
-	} else {
-		pr_alert(LOG_TAG "proc setting file write failed\n");
-		return -ENOMEM;
+static void thaFifoPublish(struct exosensepi_tha_record *rec);
+
+static void historyAddNow(enum exosensepi_history_series series, int32_t val);
+
+static void thaSchedule(unsigned long delay_usec) {
+	if (!tha_running) {
+		return;
 	}
+	hrtimer_start(&tha_timer, ktime_set(0, delay_usec * 1000),
+			HRTIMER_MODE_REL);
 }
 
-struct GpioBean* gpioGetBean(struct device *dev, struct device_attribute *attr) {
-	struct DeviceAttrBean *dab;
-	dab = container_of(attr, struct DeviceAttrBean, devAttr);
-	if (dab == NULL) {
-		return NULL;
+static void thaNextCycle(void) {
+	thaStatAdd(THA_STAT_CYCLE, tha_cycle_start);
+	thaCount(&tha_counters.cycles);
+	tha_retries = 0;
+	tha_state = THA_STATE_START;
+	if (!tha_running) {
+		return;
 	}
-	return dab->gpio;
+	hrtimer_start(&tha_timer,
+			ktime_add_ms(tha_cycle_start, THA_VOC_INTERVAL_MS),
+			HRTIMER_MODE_ABS);
 }
 
-struct WiegandBean* wiegandGetBean(struct device *dev,
-		struct device_attribute *attr) {
-	return &w;
+static void thaRetry(void) {
+	tha_retries++;
+	if (tha_retries >= THA_MAX_ATTEMPTS) {
+		thaCount(&tha_counters.failures);
+		thaNextCycle();
+		return;
+	}
+	thaCount(&tha_counters.retries);
+	tha_state = THA_STATE_START;
+	thaSchedule(0);
 }
 
-static ssize_t devAttrPirOnCounter_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t count) {
-	unsigned long val;
+static void thaVocStateRestore(void) {
+	int32_t state[2];
+	bool set;
 
-	int ret = kstrtoul(buf, 10, &val);
-	if (ret < 0) {
-		return ret;
+	spin_lock(&tha_voc_state_lock);
+	set = tha_voc_state_set_req;
+	state[0] = tha_voc_state_req[0];
+	state[1] = tha_voc_state_req[1];
+	tha_voc_state_set_req = false;
+	spin_unlock(&tha_voc_state_lock);
+
+	if (set) {
+		VocAlgorithm_set_states(&voc_algorithm_params, state[0], state[1]);
+		tha_voc_cycles = THA_VOC_STATE_MIN_CYCLES;
 	}
-	if (val != 0) {
-		return -EINVAL;
+}
+
+static void thaVocProcess(void) {
+	int32_t state[2];
+	ktime_t ts;
+
+	ts = ktime_get();
+	VocAlgorithm_process(&voc_algorithm_params, tha_acq.sraw, &tha_voc_index);
+	VocAlgorithm_get_states(&voc_algorithm_params, &state[0], &state[1]);
+	thaStatAdd(THA_STAT_VOC, ts);
+
+	if (tha_voc_cycles < THA_VOC_STATE_MIN_CYCLES) {
+		tha_voc_cycles++;
 	}
 
-	gpioPir.onCnt = 0;
+	spin_lock(&tha_voc_state_lock);
+	tha_voc_state[0] = state[0];
+	tha_voc_state[1] = state[1];
+	// states are meaningful only after 3 hours of learning or once restored
+	tha_voc_state_valid = tha_voc_cycles >= THA_VOC_STATE_MIN_CYCLES;
+	spin_unlock(&tha_voc_state_lock);
+}
 
-	return count;
+/*
+ * Applies settings changed via sysfs. Called at the beginning of a cycle so
+ * that they never change between a measurement trigger and its read-out.
+ */
+static void thaApplySettings(void) {
+	if (tha_sht_repeatability != tha_sht_repeatability_req) {
+		tha_sht_repeatability = tha_sht_repeatability_req;
+		sht4x_set_repeatability(tha_sht_repeatability);
+	}
+	tha_interval_sec = tha_interval_sec_req;
+	thaDtMedianResize();
+	thaVocStateRestore();
 }
 
-static bool exosensepi_i2c_lock(void) {
-	uint8_t i;
-	for (i = 0; i < 20; i++) {
-		if (mutex_trylock(&exosensepi_i2c_mutex)) {
-			return true;
+static void thaPublish(void) {
+	int32_t t, rh, dt, tCal, rhCal;
+	struct exosensepi_tha_record rec;
+
+	t = tha_acq.t;
+	rh = tha_acq.rh;
+	thaCalibrate(&t, &rh, tha_acq.t9, tha_acq.t16, &dt, &tCal, &rhCal);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.seq = ++tha_seq;
+	rec.ts_ns = ktime_get_ns();
+	rec.t = t;
+	rec.t_cal = tCal;
+	rec.rh = rh;
+	rec.rh_cal = rhCal;
+	rec.dt = dt;
+	rec.voc_index = tha_voc_index;
+	rec.sraw = tha_acq.sraw;
+
+	write_seqlock(&tha_sample_lock);
+	tha_sample = rec;
+	write_sequnlock(&tha_sample_lock);
+
+	thaFifoPublish(&rec);
+	thaCount(&tha_counters.samples);
+
+	historyAddNow(EXOSENSEPI_HISTORY_T_CAL, tCal);
+	historyAddNow(EXOSENSEPI_HISTORY_RH_CAL, rhCal);
+	historyAddNow(EXOSENSEPI_HISTORY_VOC_INDEX, tha_voc_index);
+}
+
+/*
+ * THA acquisition state machine, run once per second to keep the SGP40 and
+ * the VOC algorithm on their 1 Hz cadence. SHT4x and LM75 are read only every
+ * tha_interval_sec cycles, the other cycles use the last read temperature and
+ * humidity for the SGP40 compensation.
+ *
+ * Each step takes the I2C lock only for the bus transfers it performs, the
+ * sensors' conversion times are waited on with the bus released:
+ *
+ * SHT_TRIGGER: start SHT4x measurement
+ * SHT_READ: read SHT4x, read both LM75, start SGP40 measurement
+ * SGP_TRIGGER: start SGP40 measurement
+ * SGP_READ: read SGP40, run the VOC algorithm, publish the sample if SHT4x
+ * was read in this cycle
+ *
+ * A failed step restarts the cycle, up to THA_MAX_ATTEMPTS times.
+ */
+static void thaWorkFunction(struct work_struct *work) {
+	int16_t ret;
+	ktime_t ts;
+
+	if (tha_state == THA_STATE_START) {
+		if (tha_retries == 0) {
+			tha_cycle_start = ktime_get();
+			thaApplySettings();
+			tha_sht_cycles++;
+			tha_cycle_sht = tha_seq == 0 || tha_sht_cycles >= tha_interval_sec;
+		}
+		tha_state = tha_cycle_sht ?
+				THA_STATE_SHT_TRIGGER : THA_STATE_SGP_TRIGGER;
+	}
+
+	ts = ktime_get();
+	if (!exosensepi_i2c_lock()) {
+		thaStatAdd(THA_STAT_LOCK_WAIT, ts);
+		thaCount(&tha_counters.lockFailures);
+		thaSchedule(THA_LOCK_RETRY_USEC);
+		return;
+	}
+	ts = thaStatAdd(THA_STAT_LOCK_WAIT, ts);
+
+	switch (tha_state) {
+	case THA_STATE_SHT_TRIGGER:
+		ret = sht4x_measure();
+		thaStatAdd(THA_STAT_SHT, ts);
+		break;
+
+	case THA_STATE_SHT_READ:
+		ret = sht4x_read(&tha_acq.t, &tha_acq.rh);
+		ts = thaStatAdd(THA_STAT_SHT, ts);
+		if (ret == 0) {
+			ret = lm75aRead(lm75aU9_i2c_client, &tha_acq.t9);
+			ts = thaStatAdd(THA_STAT_LM75, ts);
+		}
+		if (ret == 0) {
+			ret = lm75aRead(lm75aU16_i2c_client, &tha_acq.t16);
+			ts = thaStatAdd(THA_STAT_LM75, ts);
+		}
+		if (ret == 0) {
+			ret = sgp40_measure_raw_with_rht(tha_acq.rh, tha_acq.t);
+			thaStatAdd(THA_STAT_SGP, ts);
+		}
+		break;
+
+	case THA_STATE_SGP_TRIGGER:
+		ret = sgp40_measure_raw_with_rht(tha_acq.rh, tha_acq.t);
+		thaStatAdd(THA_STAT_SGP, ts);
+		break;
+
+	case THA_STATE_SGP_READ:
+		ret = sgp40_read_raw(&tha_acq.sraw);
+		thaStatAdd(THA_STAT_SGP, ts);
+		break;
+
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	exosensepi_i2c_unlock();
+
+	if (ret < 0) {
+		thaStatError(ret);
+		thaRetry();
+		return;
+	}
+
+	switch (tha_state) {
+	case THA_STATE_SHT_TRIGGER:
+		tha_state = THA_STATE_SHT_READ;
+		thaSchedule(sht4x_get_measurement_duration_usec());
+		break;
+
+	case THA_STATE_SHT_READ:
+	case THA_STATE_SGP_TRIGGER:
+		tha_state = THA_STATE_SGP_READ;
+		thaSchedule(SGP40_CMD_MEASURE_RAW_DURATION_US);
+		break;
+
+	case THA_STATE_SGP_READ:
+		thaVocProcess();
+		if (tha_cycle_sht) {
+			thaPublish();
+			tha_sht_cycles = 0;
 		}
-		msleep(1);
+		thaNextCycle();
+		break;
+
+	default:
+		break;
 	}
-	return false;
 }
 
-static void exosensepi_i2c_unlock(void) {
-	mutex_unlock(&exosensepi_i2c_mutex);
+static enum hrtimer_restart thaTimerHandler(struct hrtimer *tmr) {
+	if (tha_running) {
+		queue_work(tha_wq, &tha_work);
+	}
+	return HRTIMER_NORESTART;
 }
 
-static struct i2c_client* sensirion_i2c_client_get(uint8_t address) {
-	if (sht40_i2c_client != NULL && sht40_i2c_client->addr == address) {
-		return sht40_i2c_client;
+static int thaStatsShow(struct seq_file *m, void *v) {
+	struct ThaCounters *c = &tha_counters;
+	int i;
+
+	// printed in place, the error table is too large for the stack
+	mutex_lock(&tha_counters_mutex);
+	seq_printf(m, "cycles=%llu samples=%llu retries=%llu failures=%llu "
+			"lock_failures=%llu\n", c->cycles, c->samples, c->retries,
+			c->failures, c->lockFailures);
+	for (i = 0; i < ARRAY_SIZE(tha_state_names); i++) {
+		if (c->stateErrors[i] > 0) {
+			seq_printf(m, "errors %s: %llu\n", tha_state_names[i],
+					c->stateErrors[i]);
+		}
 	}
-	if (sgp40_i2c_client != NULL && sgp40_i2c_client->addr == address) {
-		return sgp40_i2c_client;
+	for (i = 0; i < THA_ERR_CODES; i++) {
+		if (c->errors[i] > 0) {
+			seq_printf(m, "errors code %d: %llu\n", -i, c->errors[i]);
+		}
 	}
-	return NULL;
+	if (c->errors[THA_ERR_CODES] > 0) {
+		seq_printf(m, "errors code other: %llu\n", c->errors[THA_ERR_CODES]);
+	}
+	mutex_unlock(&tha_counters_mutex);
+	for (i = 0; i < THA_STAT_SIZE; i++) {
+		statsHistShow(m, &tha_stats[i], "us");
+	}
+	return 0;
 }
 
-/**
- * Execute one write transaction on the I2C bus, sending a given number of
- * bytes. The bytes in the supplied buffer must be sent to the given address. If
- * the slave device does not acknowledge any of the bytes, an error shall be
- * returned.
- *
- * @param address 7-bit I2C address to write to
- * @param data    pointer to the buffer containing the data to write
- * @param count   number of bytes to read from the buffer and send over I2C
- * @returns 0 on success, error code otherwise
- */
-int8_t sensirion_i2c_write(uint8_t address, const uint8_t *data,
-		uint16_t count) {
-	struct i2c_client *client;
+static int thaStatsOpen(struct inode *inode, struct file *file) {
+	return single_open(file, thaStatsShow, NULL);
+}
 
-	client = sensirion_i2c_client_get(address);
-	if (client == NULL) {
-		return -ENODEV;
+static ssize_t thaStatsWrite(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	int i;
+
+	// any write resets the statistics
+	mutex_lock(&tha_counters_mutex);
+	memset(&tha_counters, 0, sizeof(tha_counters));
+	mutex_unlock(&tha_counters_mutex);
+	for (i = 0; i < THA_STAT_SIZE; i++) {
+		statsHistReset(&tha_stats[i]);
 	}
-	if (i2c_master_send(client, data, count) != count) {
-		return -EIO;
+	return count;
+}
+
+static const struct file_operations tha_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = thaStatsOpen,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = thaStatsWrite,
+};
+
+static void thaStatsInit(void) {
+	int i;
+
+	for (i = 0; i < THA_STAT_SIZE; i++) {
+		statsHistInit(&tha_stats[i], tha_stat_names[i]);
+	}
+	debugfs_create_file("tha_stats", 0600, debugfs_dir, NULL,
+			&tha_stats_fops);
+}
+
+static int thaStart(void) {
+	tha_wq = alloc_ordered_workqueue("exosensepi_tha", WQ_HIGHPRI);
+	if (tha_wq == NULL) {
+		return -ENOMEM;
 	}
+	INIT_WORK(&tha_work, thaWorkFunction);
+	hrtimer_init(&tha_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	tha_timer.function = &thaTimerHandler;
+	tha_state = THA_STATE_START;
+	tha_retries = 0;
+	tha_running = true;
+	queue_work(tha_wq, &tha_work);
 	return 0;
 }
 
-/**
- * Execute one read transaction on the I2C bus, reading a given number of bytes.
- * If the device does not acknowledge the read command, an error shall be
- * returned.
- *
- * @param address 7-bit I2C address to read from
- * @param data    pointer to the buffer where the data is to be stored
- * @param count   number of bytes to read from I2C and store in the buffer
- * @returns 0 on success, error code otherwise
- */
-int8_t sensirion_i2c_read(uint8_t address, uint8_t *data, uint16_t count) {
-	struct i2c_client *client;
+static void thaStop(void) {
+	if (tha_wq == NULL) {
+		return;
+	}
+	tha_running = false;
+	cancel_work_sync(&tha_work);
+	hrtimer_cancel(&tha_timer);
+	cancel_work_sync(&tha_work);
+	destroy_workqueue(tha_wq);
+	tha_wq = NULL;
+}
 
-	client = sensirion_i2c_client_get(address);
-	if (client == NULL) {
-		return -ENODEV;
+static void thaFifoPublish(struct exosensepi_tha_record *rec) {
+	struct ThaReader *r;
+
+	// the mutex only guards the list, readers never hold it
+	mutex_lock(&tha_readers_mutex);
+	list_for_each_entry(r, &tha_readers, list) {
+		spin_lock(&r->lock);
+		if (kfifo_is_full(&r->fifo)) {
+			// drop the oldest record
+			kfifo_skip(&r->fifo);
+		}
+		kfifo_put(&r->fifo, *rec);
+		spin_unlock(&r->lock);
 	}
-	if (i2c_master_recv(client, data, count) != count) {
-		return -EIO;
+	mutex_unlock(&tha_readers_mutex);
+
+	wake_up_interruptible(&tha_readers_wq);
+}
+
+static int thaDevOpen(struct inode *inode, struct file *file) {
+	struct ThaReader *r;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (r == NULL) {
+		return -ENOMEM;
 	}
+	if (kfifo_alloc(&r->fifo, THA_FIFO_SIZE, GFP_KERNEL)) {
+		kfree(r);
+		return -ENOMEM;
+	}
+	spin_lock_init(&r->lock);
+
+	mutex_lock(&tha_readers_mutex);
+	list_add_tail(&r->list, &tha_readers);
+	mutex_unlock(&tha_readers_mutex);
+
+	file->private_data = r;
+	return nonseekable_open(inode, file);
+}
+
+static int thaDevRelease(struct inode *inode, struct file *file) {
+	struct ThaReader *r = file->private_data;
+
+	mutex_lock(&tha_readers_mutex);
+	list_del(&r->list);
+	mutex_unlock(&tha_readers_mutex);
+
+	kfifo_free(&r->fifo);
+	kfree(r);
 	return 0;
 }
 
-/**
- * Sleep for a given number of microseconds. The function should delay the
- * execution for at least the given time, but may also sleep longer.
- *
- * Despite the unit, a <10 millisecond precision is sufficient.
- *
- * @param useconds the sleep time in microseconds
- */
-void sensirion_sleep_usec(uint32_t useconds) {
-	msleep((useconds / 1000) + 1);
+static ssize_t thaDevRead(struct file *file, char __user *buf, size_t count,
+		loff_t *ppos) {
+	struct ThaReader *r = file->private_data;
+	struct exosensepi_tha_record batch[8];
+	unsigned int n;
+	ssize_t copied = 0;
+
+	if (count < sizeof(batch[0])) {
+		return -EINVAL;
+	}
+
+	while (kfifo_is_empty(&r->fifo)) {
+		if (file->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		if (wait_event_interruptible(tha_readers_wq,
+				!kfifo_is_empty(&r->fifo))) {
+			return -ERESTARTSYS;
+		}
+	}
+
+	while (count - copied >= sizeof(batch[0])) {
+		n = min_t(size_t, ARRAY_SIZE(batch),
+				(count - copied) / sizeof(batch[0]));
+		// copy_to_user() may fault, so it cannot stall the THA work
+		spin_lock(&r->lock);
+		n = kfifo_out(&r->fifo, batch, n);
+		spin_unlock(&r->lock);
+		if (n == 0) {
+			break;
+		}
+		if (copy_to_user(buf + copied, batch, n * sizeof(batch[0]))) {
+			return -EFAULT;
+		}
+		copied += n * sizeof(batch[0]);
+	}
+
+	return copied;
 }
 
-static int16_t lm75aRead(struct i2c_client *client, int32_t *temp) {
-	if (client == NULL) {
-		return -ENODEV;
+static __poll_t thaDevPoll(struct file *file, poll_table *wait) {
+	struct ThaReader *r = file->private_data;
+
+	poll_wait(file, &tha_readers_wq, wait);
+	if (!kfifo_is_empty(&r->fifo)) {
+		return EPOLLIN | EPOLLRDNORM;
 	}
+	return 0;
+}
 
-	*temp = i2c_smbus_read_word_data(client, 0);
+static const struct file_operations tha_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = thaDevOpen,
+	.release = thaDevRelease,
+	.read = thaDevRead,
+	.poll = thaDevPoll,
+};
 
-	if (*temp < 0) {
-		return *temp;
+static struct miscdevice tha_misc_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "exosensepi_tha",
+	.fops = &tha_dev_fops,
+	.mode = 0440,
+};
+
+static void historyAddNow(enum exosensepi_history_series series, int32_t val) {
+	historyAdd(&history[series], ktime_get_real_seconds(), val);
+}
+
+static int historyDevOpen(struct inode *inode, struct file *file) {
+	struct HistoryReader *r;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (r == NULL) {
+		return -ENOMEM;
 	}
+	mutex_init(&r->lock);
 
-	*temp = ((*temp & 0xff) << 8) + ((*temp >> 8) & 0xe0);
-	*temp = ((int16_t) * temp) * 100 / 256;
+	file->private_data = r;
+	return nonseekable_open(inode, file);
+}
+
+static int historyDevRelease(struct inode *inode, struct file *file) {
+	struct HistoryReader *r = file->private_data;
 
+	kvfree(r->points);
+	kfree(r);
 	return 0;
 }
 
-static int32_t cmpint32(const void *a, const void *b) {
-	return *(int32_t*) a - *(int32_t*) b;
+/*
+ * A write selects the range returned by the following reads: the matching
+ * buckets are copied at once, so the result is consistent even if new
+ * samples arrive while it is being read.
+ */
+static ssize_t historyDevWrite(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct HistoryReader *r = file->private_data;
+	struct exosensepi_history_query q;
+	struct HistoryPoint *points;
+	unsigned int n, max;
+
+	if (count != sizeof(q)) {
+		return -EINVAL;
+	}
+	if (copy_from_user(&q, buf, sizeof(q))) {
+		return -EFAULT;
+	}
+	if (q.series >= EXOSENSEPI_HISTORY_SERIES || q.level >= HISTORY_LEVELS) {
+		return -EINVAL;
+	}
+
+	// completed buckets plus the one being accumulated
+	max = history_size[q.level] + 1;
+	points = kvmalloc_array(max, sizeof(*points), GFP_KERNEL);
+	if (points == NULL) {
+		return -ENOMEM;
+	}
+	n = historyGet(&history[q.series], q.level, q.from, q.to, points, max);
+
+	if (mutex_lock_interruptible(&r->lock)) {
+		kvfree(points);
+		return -ERESTARTSYS;
+	}
+	kvfree(r->points);
+	r->points = points;
+	r->count = n;
+	r->next = 0;
+	r->periodSec = history_period_sec[q.level];
+	mutex_unlock(&r->lock);
+
+	return count;
 }
 
-static int16_t thaReadCalibrate(int32_t *t, int32_t *rh, int32_t *dt,
-		int32_t *tCal, int32_t *rhCal, uint16_t *sraw, int32_t *voc_index) {
-	int rhIdx, i;
-	int16_t ret;
-	int32_t t9, t16, tOff;
+static ssize_t historyDevRead(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct HistoryReader *r = file->private_data;
+	struct exosensepi_history_point rec;
+	struct HistoryPoint *p;
+	ssize_t copied = 0;
 
-	ret = sht4x_measure_blocking_read(t, rh);
-	if (ret < 0) {
-		return ret;
+	if (count < sizeof(rec)) {
+		return -EINVAL;
 	}
 
-	ret = lm75aRead(lm75aU9_i2c_client, &t9);
-	if (ret < 0) {
-		return ret;
+	if (mutex_lock_interruptible(&r->lock)) {
+		return -ERESTARTSYS;
+	}
+	while (r->next < r->count && count - copied >= sizeof(rec)) {
+		p = &r->points[r->next];
+		memset(&rec, 0, sizeof(rec));
+		rec.ts = p->ts;
+		rec.sum = p->sum;
+		rec.min = p->min;
+		rec.max = p->max;
+		rec.count = p->count;
+		rec.period = r->periodSec;
+		if (copy_to_user(buf + copied, &rec, sizeof(rec))) {
+			copied = -EFAULT;
+			break;
+		}
+		copied += sizeof(rec);
+		r->next++;
 	}
+	mutex_unlock(&r->lock);
 
-	ret = lm75aRead(lm75aU16_i2c_client, &t16);
-	if (ret < 0) {
-		return ret;
+	return copied;
+}
+
+static const struct file_operations history_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = historyDevOpen,
+	.release = historyDevRelease,
+	.read = historyDevRead,
+	.write = historyDevWrite,
+};
+
+static struct miscdevice history_misc_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "exosensepi_history",
+	.fops = &history_dev_fops,
+	.mode = 0660,
+};
+
+static bool ioLineConfigured(struct GpioBean *g) {
+	if (g->desc == NULL || IS_ERR(g->desc)) {
+		return false;
 	}
+	return g->flags == GPIOD_IN || g->flags == GPIOD_OUT_LOW
+			|| g->flags == GPIOD_OUT_HIGH;
+}
 
-	ret = sgp40_measure_raw_with_rht_blocking_read(*rh, *t, sraw);
-	if (ret < 0) {
-		return ret;
+static void ioSnapshot(struct exosensepi_io_state *st) {
+	struct IoLineBean *l;
+	int i;
+
+	memset(st, 0, sizeof(*st));
+	// line levels first, as close as possible to each other
+	for (l = ioLines; l->gpio != NULL; l++) {
+		if (ioLineConfigured(l->gpio)) {
+			st->valid |= l->bit;
+			if (gpioGetVal(l->gpio)) {
+				st->values |= l->bit;
+			}
+		}
+	}
+	st->ts_ns = ktime_get_ns();
+
+	for (i = 0; i < DI_SIZE; i++) {
+		st->di_deb[i] = gpioDI[i].value;
+		st->di_on_cnt[i] = atomic64_read(&gpioDI[i].onCnt);
+		st->di_off_cnt[i] = atomic64_read(&gpioDI[i].offCnt);
+		st->di_pulse_cnt[i] = gpioPulseCount(&gpioDI[i]);
+	}
+	st->pir_deb = gpioPir.value;
+	st->pir_on_cnt = atomic64_read(&gpioPir.onCnt);
+}
+
+/*
+ * Sets all the selected outputs, or none if any of them is not configured
+ * as output.
+ */
+static int ioSetOutputs(u32 mask, u32 values) {
+	struct IoLineBean *l;
+
+	for (l = ioLines; l->gpio != NULL; l++) {
+		if ((mask & l->bit) && l->gpio->flags != GPIOD_OUT_LOW
+				&& l->gpio->flags != GPIOD_OUT_HIGH) {
+			return -EPERM;
+		}
+	}
+	for (l = ioLines; l->gpio != NULL; l++) {
+		if (mask & l->bit) {
+			gpioOutput(l->gpio, (values & l->bit) ? 1 : 0);
+		}
 	}
+	return 0;
+}
 
-	VocAlgorithm_process(&voc_algorithm_params, *sraw, voc_index);
+static long ioDevIoctl(struct file *file, unsigned int cmd,
+		unsigned long arg) {
+	struct exosensepi_io_state st;
+	struct exosensepi_io_outputs out;
 
-	*dt = t16 - t9;
-	if (*dt < 0) {
-		*dt = 0;
-	}
+	switch (cmd) {
+	case EXOSENSEPI_IOC_GET_IO:
+		ioSnapshot(&st);
+		if (copy_to_user((void __user*) arg, &st, sizeof(st))) {
+			return -EFAULT;
+		}
+		return 0;
 
-	if (tha_ready) {
-		tha_dt_median_buff[tha_dt_idx] = *dt;
-	} else {
-		for (i = 0; i < THA_DT_MEDIAN_SAMPLES; i++) {
-			tha_dt_median_buff[i] = *dt;
+	case EXOSENSEPI_IOC_SET_OUTPUTS:
+		if (copy_from_user(&out, (void __user*) arg, sizeof(out))) {
+			return -EFAULT;
 		}
-	}
-	tha_dt_idx = (tha_dt_idx + 1) % THA_DT_MEDIAN_SAMPLES;
+		return ioSetOutputs(out.mask, out.values);
 
-	for (i = 0; i < THA_DT_MEDIAN_SAMPLES; i++) {
-		tha_dt_median_sort[i] = tha_dt_median_buff[i];
+	default:
+		return -ENOTTY;
 	}
-	sort(tha_dt_median_sort, THA_DT_MEDIAN_SAMPLES, sizeof(int32_t), &cmpint32,
-			NULL);
-
-	*dt = tha_dt_median_sort[THA_DT_MEDIAN_SAMPLES / 2];
+}
 
-	// t [°C/1000]
-	// rh [%/1000]
-	// t9,t16,dt [°C/100]
-	// tha_temp_offset [°C/100]
-	// temp_calib_b [°C/1000]
-	// temp_calib_m [1/1000]
+static const struct file_operations io_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = nonseekable_open,
+	.unlocked_ioctl = ioDevIoctl,
+	.compat_ioctl = compat_ptr_ioctl,
+};
 
-	*tCal = (
-			(100 * (*t)) // 100 * t [°C/1000] = t [°C/100000]
-			+ (temp_calib_m * (*dt)) // temp_calib_m [1/1000] * dt [°C/100] = temp_calib_m * 1000 * dt [°C/100] = temp_calib_m * dt [°C/100000]
-					+ (100 * temp_calib_b) // 100 * temp_calib_b [°C/1000] = temp_calib_b [°C/100000]
-			);// [°C/100000]
-	*tCal = DIV_ROUND_CLOSEST(*tCal, 1000) + tha_temp_offset; // [°C/100]
+static struct miscdevice io_misc_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "exosensepi_io",
+	.fops = &io_dev_fops,
+	.mode = 0660,
+};
 
-	*t /= 10; // [°C/100]
-	*rh /= 10; // [%/100]
+static ssize_t devAttrIoState_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct exosensepi_io_state st;
+
+	ioSnapshot(&st);
+	return sprintf(buf, "%02x %02x %d %d %d %llu %llu %llu %llu %llu %llu %llu\n",
+			st.values, st.valid, st.di_deb[DI1], st.di_deb[DI2], st.pir_deb,
+			st.di_on_cnt[DI1], st.di_off_cnt[DI1], st.di_on_cnt[DI2],
+			st.di_off_cnt[DI2], st.di_pulse_cnt[DI1], st.di_pulse_cnt[DI2],
+			st.pir_on_cnt);
+}
 
-	tOff = (*t) - (*tCal); // [°C/100]
-	tOff = DIV_ROUND_CLOSEST(tOff, 10); // [°C/10]
+static ssize_t devAttrIoState_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	unsigned int mask, values;
+	int ret;
 
-	if (tOff < RH_ADJ_MIN_TEMP_OFFSET) {
-		tOff = RH_ADJ_MIN_TEMP_OFFSET;
-	} else if (tOff > RH_ADJ_MAX_TEMP_OFFSET - 1) {
-		tOff = RH_ADJ_MAX_TEMP_OFFSET - 1;
+	if (sscanf(buf, "%x %x", &mask, &values) != 2) {
+		return -EINVAL;
 	}
-	rhIdx = tOff - RH_ADJ_MIN_TEMP_OFFSET;
-	*rhCal = (*rh) * RH_ADJ_FACTOR / rhAdjLookup[rhIdx];
-	if (*rhCal > 10000) {
-		*rhCal = 10000;
-	} else if (*rhCal < 0) {
-		*rhCal = 0;
+	ret = ioSetOutputs(mask, values);
+	if (ret < 0) {
+		return ret;
 	}
-
-	return 0;
+	return count;
 }
 
-static int thaThreadFunction(void *data) {
-	int16_t i, ret;
-	int32_t t, rh, dt, tCal, rhCal, voc_index;
-	uint16_t sraw;
+static ssize_t devAttrIoRules_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	return rulesShow(&ioRules, buf);
+}
 
-	while (!kthread_should_stop()) {
-		if (!exosensepi_i2c_lock()) {
-			msleep(100);
-			continue;
-		}
+static ssize_t devAttrIoRules_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
 
-		for (i = 0; i < 3; i++) {
-			ret = thaReadCalibrate(&t, &rh, &dt, &tCal, &rhCal, &sraw,
-					&voc_index);
-			if (ret == 0) {
-				tha_t = t;
-				tha_rh = rh;
-				tha_dt = dt;
-				tha_tCal = tCal;
-				tha_rhCal = rhCal;
-				tha_voc_index = voc_index;
-				tha_sraw = sraw;
-				tha_ready = true;
-				break;
-			}
-		}
+	ret = rulesParse(&ioRules, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
 
-		exosensepi_i2c_unlock();
+/*
+ * Copies the latest published sample without blocking the THA work.
+ * Returns false if no sample is available yet.
+ */
+static bool thaSnapshot(struct exosensepi_tha_record *rec) {
+	unsigned int seq;
 
-		msleep(THA_READ_INTERVAL_MS);
-	}
+	do {
+		seq = read_seqbegin(&tha_sample_lock);
+		*rec = tha_sample;
+	} while (read_seqretry(&tha_sample_lock, seq));
 
-	return 0;
+	return rec->seq != 0;
 }
 
 static ssize_t devAttrThaTh_show(struct device *dev,
 		struct device_attribute *attr, char *buf) {
-	if (!tha_ready) {
+	struct exosensepi_tha_record rec;
+
+	if (!thaSnapshot(&rec)) {
 		return -EBUSY;
 	}
 
-	return sprintf(buf, "%d %d %d %d %d\n", tha_dt, tha_t, tha_tCal, tha_rh,
-			tha_rhCal);
+	return sprintf(buf, "%d %d %d %d %d\n", rec.dt, rec.t, rec.t_cal, rec.rh,
+			rec.rh_cal);
 }
 
 static ssize_t devAttrThaThv_show(struct device *dev,
 		struct device_attribute *attr, char *buf) {
-	if (!tha_ready) {
+	struct exosensepi_tha_record rec;
+
+	if (!thaSnapshot(&rec)) {
+		return -EBUSY;
+	}
+
+	return sprintf(buf, "%d %d %d %d %d %d %d\n", rec.dt, rec.t, rec.t_cal,
+			rec.rh, rec.rh_cal, rec.sraw, rec.voc_index);
+}
+
+static ssize_t devAttrThaThvSeq_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct exosensepi_tha_record rec;
+
+	if (!thaSnapshot(&rec)) {
 		return -EBUSY;
 	}
 
-	return sprintf(buf, "%d %d %d %d %d %d %d\n", tha_dt, tha_t, tha_tCal,
-			tha_rh, tha_rhCal, tha_sraw, tha_voc_index);
+	return sprintf(buf, "%u %d %d %d %d %d %d %d\n", rec.seq, rec.dt, rec.t,
+			rec.t_cal, rec.rh, rec.rh_cal, rec.sraw, rec.voc_index);
 }
 
 static ssize_t devAttrThaTempOffset_show(struct device *dev,
@@ -1376,64 +3238,295 @@ static ssize_t devAttrThaTempOffset_store(struct device *dev,
 	return count;
 }
 
-static ssize_t devAttrLm75aU9_show(struct device *dev,
-		struct device_attribute *attr,
-		char *buf) {
-	return devAttrLm75a_show(lm75aU9_i2c_client, dev, attr, buf);
+static ssize_t devAttrThaDtMedianSec_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	return sprintf(buf, "%u\n", tha_dt_median_period_sec);
 }
 
-static ssize_t devAttrLm75aU16_show(struct device *dev,
-		struct device_attribute *attr,
-		char *buf) {
-	return devAttrLm75a_show(lm75aU16_i2c_client, dev, attr, buf);
+static ssize_t devAttrThaDtMedianSec_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
+	unsigned int val;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (val < 1 || val > THA_DT_MEDIAN_PERIOD_MAX_SEC) {
+		return -EINVAL;
+	}
+
+	tha_dt_median_period_sec = val;
+
+	return count;
 }
 
-static ssize_t devAttrLm75a_show(struct i2c_client *client, struct device *dev,
+static ssize_t devAttrThaIntervalSec_show(struct device *dev,
 		struct device_attribute *attr, char *buf) {
-	int16_t res;
-	int32_t temp;
+	return sprintf(buf, "%u\n", tha_interval_sec_req);
+}
 
-	if (!exosensepi_i2c_lock()) {
+static ssize_t devAttrThaIntervalSec_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
+	unsigned int val;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (val < 1 || val > THA_INTERVAL_MAX_SEC) {
+		return -EINVAL;
+	}
+
+	tha_interval_sec_req = val;
+
+	return count;
+}
+
+static ssize_t devAttrThaShtPrecision_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	switch (tha_sht_repeatability_req) {
+	case SHT4X_REPEATABILITY_MEDIUM:
+		return sprintf(buf, "medium\n");
+	case SHT4X_REPEATABILITY_LOW:
+		return sprintf(buf, "low\n");
+	default:
+		return sprintf(buf, "high\n");
+	}
+}
+
+static ssize_t devAttrThaShtPrecision_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	if (toUpper(buf[0]) == 'H') {
+		tha_sht_repeatability_req = SHT4X_REPEATABILITY_HIGH;
+	} else if (toUpper(buf[0]) == 'M') {
+		tha_sht_repeatability_req = SHT4X_REPEATABILITY_MEDIUM;
+	} else if (toUpper(buf[0]) == 'L') {
+		tha_sht_repeatability_req = SHT4X_REPEATABILITY_LOW;
+	} else {
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static ssize_t devAttrThaVocState_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	int32_t state[2];
+	bool valid;
+
+	spin_lock(&tha_voc_state_lock);
+	valid = tha_voc_state_valid;
+	state[0] = tha_voc_state[0];
+	state[1] = tha_voc_state[1];
+	spin_unlock(&tha_voc_state_lock);
+
+	if (!valid) {
 		return -EBUSY;
 	}
 
-	res = lm75aRead(client, &temp);
+	return sprintf(buf, "%d %d\n", state[0], state[1]);
+}
 
-	exosensepi_i2c_unlock();
+static ssize_t devAttrThaVocState_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int32_t state[2];
 
-	if (res < 0) {
-		return res;
+	if (sscanf(buf, "%d %d", &state[0], &state[1]) != 2) {
+		return -EINVAL;
 	}
 
-	return sprintf(buf, "%d\n", temp);
+	spin_lock(&tha_voc_state_lock);
+	tha_voc_state_req[0] = state[0];
+	tha_voc_state_req[1] = state[1];
+	tha_voc_state_set_req = true;
+	spin_unlock(&tha_voc_state_lock);
+
+	return count;
 }
 
-static ssize_t opt3001_show(struct device *dev, struct device_attribute *attr,
-		char *buf) {
-	int32_t res;
+static int16_t opt3001Read(struct i2c_client *client, int32_t *lux) {
 	int16_t man, exp;
 
-	if (opt3001_i2c_client == NULL) {
+	if (client == NULL) {
 		return -ENODEV;
 	}
 
+	*lux = i2c_smbus_read_word_data(client, 0);
+
+	if (*lux < 0) {
+		return *lux;
+	}
+
+	man = ((*lux & 0xf) << 8) + ((*lux >> 8) & 0xff);
+	exp = (*lux >> 4) & 0xf;
+	*lux = man * (1 << exp);
+
+	return 0;
+}
+
+static bool sensorCacheGet(struct SensorCacheBean *c, int32_t *val) {
+	unsigned int seq;
+	bool fresh;
+
+	do {
+		seq = read_seqbegin(&c->seqlock);
+		*val = c->value;
+		fresh = c->valid && ktime_ms_delta(ktime_get(), c->ts)
+				<= sensors_max_age_ms;
+	} while (read_seqretry(&c->seqlock, seq));
+
+	return fresh;
+}
+
+/*
+ * Reads the sensor and updates the cache. Must be called with c->lock held
+ * so that concurrent readers of a stale value share a single transaction.
+ */
+static int16_t sensorCacheRefresh(struct SensorCacheBean *c, int32_t *val) {
+	int16_t ret;
+
 	if (!exosensepi_i2c_lock()) {
 		return -EBUSY;
 	}
 
-	res = i2c_smbus_read_word_data(opt3001_i2c_client, 0);
+	ret = c->read(*c->client, val);
 
 	exosensepi_i2c_unlock();
 
-	if (res < 0) {
-		return res;
+	if (ret < 0) {
+		return ret;
+	}
+
+	write_seqlock(&c->seqlock);
+	c->value = *val;
+	c->ts = ktime_get();
+	c->valid = true;
+	write_sequnlock(&c->seqlock);
+
+	return 0;
+}
+
+static ssize_t sensorCacheShow(struct SensorCacheBean *c, char *buf) {
+	int16_t ret;
+	int32_t val;
+
+	if (!sensorCacheGet(c, &val)) {
+		if (mutex_lock_interruptible(&c->lock)) {
+			return -ERESTARTSYS;
+		}
+		// may have been refreshed while waiting
+		if (!sensorCacheGet(c, &val)) {
+			ret = sensorCacheRefresh(c, &val);
+		} else {
+			ret = 0;
+		}
+		mutex_unlock(&c->lock);
+
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return sprintf(buf, "%d\n", val);
+}
+
+static void sensorsSamplerSchedule(void) {
+	mutex_lock(&sensors_sampler_mutex);
+	if (sensors_sampler_running && sensors_interval_ms > 0) {
+		mod_delayed_work(system_wq, &sensors_sampler_work,
+				msecs_to_jiffies(sensors_interval_ms));
+	}
+	mutex_unlock(&sensors_sampler_mutex);
+}
+
+static void sensorsSamplerWorkFunction(struct work_struct *work) {
+	int16_t ret;
+	int32_t val;
+	int i;
+
+	for (i = 0; i < SENSOR_CACHE_SIZE; i++) {
+		mutex_lock(&sensorCaches[i].lock);
+		ret = sensorCacheRefresh(&sensorCaches[i], &val);
+		mutex_unlock(&sensorCaches[i].lock);
+		if (ret == 0 && i == SENSOR_CACHE_OPT3001) {
+			historyAddNow(EXOSENSEPI_HISTORY_LUX, val);
+		}
+	}
+
+	if (gpioPir.value >= 0) {
+		historyAddNow(EXOSENSEPI_HISTORY_PIR, gpioPir.value);
+	}
+
+	sensorsSamplerSchedule();
+}
+
+static int sensorsIntervalParamSet(const char *val,
+		const struct kernel_param *kp) {
+	int ret;
+
+	ret = param_set_uint(val, kp);
+	if (ret == 0) {
+		sensorsSamplerSchedule();
+	}
+	return ret;
+}
+
+static const struct kernel_param_ops sensors_interval_param_ops = {
+	.set = sensorsIntervalParamSet,
+	.get = param_get_uint,
+};
+
+module_param_cb(sensors_interval_ms, &sensors_interval_param_ops,
+		&sensors_interval_ms, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sensors_interval_ms, " Lux and system temperature background sampling interval in ms, 0 to disable");
+
+static void sensorsSamplerStart(void) {
+	int i;
+
+	for (i = 0; i < SENSOR_CACHE_SIZE; i++) {
+		mutex_init(&sensorCaches[i].lock);
+		seqlock_init(&sensorCaches[i].seqlock);
+		sensorCaches[i].valid = false;
+	}
+	INIT_DELAYED_WORK(&sensors_sampler_work, sensorsSamplerWorkFunction);
+	mutex_lock(&sensors_sampler_mutex);
+	sensors_sampler_running = true;
+	mutex_unlock(&sensors_sampler_mutex);
+	sensorsSamplerSchedule();
+}
+
+static void sensorsSamplerStop(void) {
+	mutex_lock(&sensors_sampler_mutex);
+	if (!sensors_sampler_running) {
+		mutex_unlock(&sensors_sampler_mutex);
+		return;
 	}
+	sensors_sampler_running = false;
+	mutex_unlock(&sensors_sampler_mutex);
+
+	// not under the mutex, which the work takes to reschedule itself
+	cancel_delayed_work_sync(&sensors_sampler_work);
+}
+
+static ssize_t devAttrLm75aU9_show(struct device *dev,
+		struct device_attribute *attr,
+		char *buf) {
+	return sensorCacheShow(&sensorCaches[SENSOR_CACHE_LM75A_U9], buf);
+}
 
-	man = ((res & 0xf) << 8) + ((res >> 8) & 0xff);
-	exp = (res >> 4) & 0xf;
-	res = man * (1 << exp);
+static ssize_t devAttrLm75aU16_show(struct device *dev,
+		struct device_attribute *attr,
+		char *buf) {
+	return sensorCacheShow(&sensorCaches[SENSOR_CACHE_LM75A_U16], buf);
+}
 
-	return sprintf(buf, "%d\n", res);
+static ssize_t opt3001_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	return sensorCacheShow(&sensorCaches[SENSOR_CACHE_OPT3001], buf);
 }
 
 static ssize_t devAttrSndEvalPeriodLEQ_show(struct device *dev,
@@ -1449,6 +3542,7 @@ static ssize_t devAttrSndEvalPeriodLEQ_store(struct device *dev,
 	if (res != 2) {
 		return -EINVAL;
 	}
+	historyAddNow(EXOSENSEPI_HISTORY_SOUND_LEQ, soundEval.period_res.l_EQ);
 	return count;
 }
 
@@ -1879,12 +3973,36 @@ static void cleanup(void) {
 	struct DeviceAttrBean *dab;
 	int i, di, ai;
 
-	if (tha_thread) {
-		kthread_stop(tha_thread);
+	thaStop();
+	sensorsSamplerStop();
+	// no rule must fire on the outputs being freed
+	rulesClear(&ioRules);
+
+	debugfs_remove_recursive(debugfs_dir);
+	debugfs_dir = NULL;
+
+	if (tha_misc_registered) {
+		misc_deregister(&tha_misc_dev);
+		tha_misc_registered = false;
+	}
+
+	if (history_misc_registered) {
+		misc_deregister(&history_misc_dev);
+		history_misc_registered = false;
+	}
+
+	for (i = 0; gpioEventsDevs[i].deb != NULL; i++) {
+		gpioEventsDevDeregister(&gpioEventsDevs[i]);
+	}
+
+	wiegandDevDeregister(&w);
+
+	if (io_misc_registered) {
+		misc_deregister(&io_misc_dev);
+		io_misc_registered = false;
 	}
 
 	i2c_del_driver(&exosensepi_i2c_driver);
-	mutex_destroy(&exosensepi_i2c_mutex);
 
 	di = 0;
 	while (devices[di].name != NULL) {
@@ -1906,6 +4024,7 @@ static void cleanup(void) {
 	}
 
 	wiegandDisable(&w);
+	wiegandFree(&w);
 
 	if (proc_folder != NULL) {
 		if (proc_file != NULL) {
@@ -1918,12 +4037,18 @@ static void cleanup(void) {
 		gpioFreeDebounce(&gpioDI[i]);
 	}
 	for (i = 0; i < TTL_SIZE; i++) {
-		gpioFree(&gpioTtl[i]);
+		gpioFreeDebounce(&gpioTtl[i]);
 	}
 	gpioFree(&gpioLed);
 	gpioFree(&gpioBuzz);
 	gpioFree(&gpioDO1);
 	gpioFreeDebounce(&gpioPir);
+	gpioCaptureFree();
+
+	medianFree(&tha_dt_median);
+	for (i = 0; i < EXOSENSEPI_HISTORY_SERIES; i++) {
+		historyFree(&history[i]);
+	}
 }
 
 static int exosensepi_init(struct platform_device *pdev) {
@@ -1933,10 +4058,40 @@ static int exosensepi_init(struct platform_device *pdev) {
 
 	pr_info(LOG_TAG "init\n");
 
+	debugfs_dir = debugfs_create_dir("exosensepi", NULL);
+	i2cLockInit();
+
 	i2c_add_driver(&exosensepi_i2c_driver);
-	mutex_init(&exosensepi_i2c_mutex);
 
 	VocAlgorithm_init(&voc_algorithm_params);
+	if (voc_state_cnt == 2) {
+		tha_voc_state_req[0] = voc_state[0];
+		tha_voc_state_req[1] = voc_state[1];
+		tha_voc_state_set_req = true;
+	}
+
+	if (dt_median_sec < 1 || dt_median_sec > THA_DT_MEDIAN_PERIOD_MAX_SEC) {
+		dt_median_sec = 600;
+	}
+	tha_dt_median_period_sec = dt_median_sec;
+	if (medianInit(&tha_dt_median, thaDtMedianSamples(dt_median_sec))) {
+		pr_alert(LOG_TAG "dt median allocation failed\n");
+		goto fail;
+	}
+
+	for (i = 0; i < EXOSENSEPI_HISTORY_SERIES; i++) {
+		if (historyInit(&history[i], history_period_sec, history_size)) {
+			pr_alert(LOG_TAG "history allocation failed\n");
+			goto fail;
+		}
+	}
+
+	sensorsSamplerStart();
+
+	rulesInit(&ioRules, debouncedGpios, patternGpios);
+	for (i = 0; debouncedGpios[i] != NULL; i++) {
+		debouncedGpios[i]->onChange = ioRulesChange;
+	}
 
 	gpioSetPlatformDev(pdev);
 
@@ -1966,7 +4121,10 @@ static int exosensepi_init(struct platform_device *pdev) {
 	gpioPir.onMinTime_usec = 0;
 	gpioPir.offMinTime_usec = 0;
 
-	wiegandInit(&w);
+	if (wiegandInit(&w)) {
+		pr_alert(LOG_TAG "Wiegand allocation failed\n");
+		goto fail;
+	}
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
 	pDeviceClass = class_create("exosensepi");
@@ -2015,9 +4173,48 @@ static int exosensepi_init(struct platform_device *pdev) {
 		goto fail;
 	}
 
-	tha_thread = kthread_run(thaThreadFunction, NULL, "exosensepi THA");
-	if (!tha_thread) {
-		pr_alert(LOG_TAG "THA thread creation failed\n");
+	if (misc_register(&tha_misc_dev)) {
+		pr_alert(LOG_TAG "failed to register THA device\n");
+		goto fail;
+	}
+	tha_misc_registered = true;
+
+	if (misc_register(&history_misc_dev)) {
+		pr_alert(LOG_TAG "failed to register history device\n");
+		goto fail;
+	}
+	history_misc_registered = true;
+
+	for (i = 0; gpioEventsDevs[i].deb != NULL; i++) {
+		if (gpioEventsDevRegister(&gpioEventsDevs[i])) {
+			pr_alert(LOG_TAG "failed to register %s device\n",
+					gpioEventsDevs[i].misc.name);
+			goto fail;
+		}
+	}
+
+	if (wiegandDevRegister(&w)) {
+		pr_alert(LOG_TAG "failed to register Wiegand device\n");
+		goto fail;
+	}
+
+	if (misc_register(&io_misc_dev)) {
+		pr_alert(LOG_TAG "failed to register I/O device\n");
+		goto fail;
+	}
+	io_misc_registered = true;
+
+	debugfs_create_file("gpio_stats", 0400, debugfs_dir, NULL,
+			&gpio_stats_fops);
+	debugfs_create_file("pwm_stats", 0600, debugfs_dir, NULL,
+			&pattern_stats_fops);
+	debugfs_create_file("capture", 0600, debugfs_dir, NULL, &capture_fops);
+	debugfs_create_file("capture_data", 0400, debugfs_dir, NULL,
+			&capture_data_fops);
+	thaStatsInit();
+
+	if (thaStart()) {
+		pr_alert(LOG_TAG "THA acquisition start failed\n");
 		goto fail;
 	}
 
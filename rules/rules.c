@@ -0,0 +1,208 @@
+#include "rules.h"
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+static const char *ruleEdgeNames[] = {
+	[RULE_EDGE_RISE] = "rise",
+	[RULE_EDGE_FALL] = "fall",
+	[RULE_EDGE_ANY] = "any",
+};
+
+static const char *ruleActionNames[] = {
+	[RULE_ACTION_ON] = "on",
+	[RULE_ACTION_OFF] = "off",
+	[RULE_ACTION_TOGGLE] = "toggle",
+	[RULE_ACTION_PULSE] = "pulse",
+	[RULE_ACTION_FOLLOW] = "follow",
+};
+
+static const char* ruleLineName(const char *name) {
+	const char *s = strrchr(name, '_');
+	return s == NULL ? name : s + 1;
+}
+
+void rulesInit(struct RulesBean *r, struct DebouncedGpioBean **sources,
+		struct GpioBean **targets) {
+	spin_lock_init(&r->lock);
+	r->count = 0;
+	r->sources = sources;
+	r->targets = targets;
+}
+
+static bool ruleMatch(struct RuleBean *rule, int prev, int val) {
+	if (prev == DEBOUNCE_STATE_NOT_DEFINED) {
+		// a settled value is not an edge, but is still mirrored
+		return rule->action == RULE_ACTION_FOLLOW
+				&& (rule->edge == RULE_EDGE_ANY
+						|| (rule->edge == RULE_EDGE_RISE) == (val == 1));
+	}
+	switch (rule->edge) {
+	case RULE_EDGE_RISE:
+		return val == 1;
+	case RULE_EDGE_FALL:
+		return val == 0;
+	default:
+		return true;
+	}
+}
+
+static void ruleFire(struct RuleBean *rule, int val) {
+	struct GpioBean *g = rule->dst;
+
+	switch (rule->action) {
+	case RULE_ACTION_ON:
+		gpioOutputAtomic(g, 1, 0);
+		break;
+	case RULE_ACTION_OFF:
+		gpioOutputAtomic(g, 0, 0);
+		break;
+	case RULE_ACTION_TOGGLE:
+		gpioOutputAtomic(g, gpioGetVal(g) ? 0 : 1, 0);
+		break;
+	case RULE_ACTION_PULSE:
+		gpioOutputAtomic(g, 1, rule->time_usec);
+		break;
+	case RULE_ACTION_FOLLOW:
+		gpioOutputAtomic(g, val, 0);
+		break;
+	}
+	rule->fired++;
+}
+
+/*
+ * Called from the debounce timer of src when its value changes.
+ */
+void rulesEval(struct RulesBean *r, struct DebouncedGpioBean *src, int prev,
+		int val) {
+	struct RuleBean *rule;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&r->lock, flags);
+	for (i = 0; i < r->count; i++) {
+		rule = &r->rules[i];
+		if (rule->src == src && ruleMatch(rule, prev, val)) {
+			ruleFire(rule, val);
+		}
+	}
+	spin_unlock_irqrestore(&r->lock, flags);
+}
+
+void rulesClear(struct RulesBean *r) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&r->lock, flags);
+	r->count = 0;
+	spin_unlock_irqrestore(&r->lock, flags);
+}
+
+static int ruleLookup(const char **names, int size, const char *name) {
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if (strcmp(names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Accepts "<src> <edge> <dst> <action> [<ms>]" to append a rule,
+ * "del <n>" to remove the n-th one and "clear" to remove all.
+ */
+int rulesParse(struct RulesBean *r, const char *buf) {
+	char src[8], edge[8], dst[8], action[8];
+	struct RuleBean rule;
+	unsigned long flags;
+	unsigned int ms = 0;
+	unsigned int n;
+	int i, e, a, ret = 0;
+
+	if (sysfs_streq(buf, "clear")) {
+		rulesClear(r);
+		return 0;
+	}
+	if (sscanf(buf, "del %u", &n) == 1) {
+		spin_lock_irqsave(&r->lock, flags);
+		if (n < r->count) {
+			memmove(&r->rules[n], &r->rules[n + 1],
+					(r->count - n - 1) * sizeof(rule));
+			r->count--;
+		} else {
+			ret = -EINVAL;
+		}
+		spin_unlock_irqrestore(&r->lock, flags);
+		return ret;
+	}
+
+	if (sscanf(buf, "%7s %7s %7s %7s %u", src, edge, dst, action, &ms) < 4) {
+		return -EINVAL;
+	}
+	e = ruleLookup(ruleEdgeNames, ARRAY_SIZE(ruleEdgeNames), edge);
+	a = ruleLookup(ruleActionNames, ARRAY_SIZE(ruleActionNames), action);
+	if (e < 0 || a < 0) {
+		return -EINVAL;
+	}
+	if (a == RULE_ACTION_PULSE) {
+		if (ms == 0 || ms > RULES_MAX_PULSE_MSEC) {
+			return -EINVAL;
+		}
+	} else if (ms != 0) {
+		return -EINVAL;
+	}
+	rule.src = NULL;
+	for (i = 0; r->sources[i] != NULL; i++) {
+		if (strcmp(ruleLineName(r->sources[i]->gpio.name), src) == 0) {
+			rule.src = r->sources[i];
+		}
+	}
+	rule.dst = NULL;
+	for (i = 0; r->targets[i] != NULL; i++) {
+		if (strcmp(ruleLineName(r->targets[i]->name), dst) == 0) {
+			rule.dst = r->targets[i];
+		}
+	}
+	if (rule.src == NULL || rule.dst == NULL) {
+		return -EINVAL;
+	}
+	rule.edge = e;
+	rule.action = a;
+	rule.time_usec = ms * 1000ul;
+	rule.fired = 0;
+
+	spin_lock_irqsave(&r->lock, flags);
+	if (r->count < RULES_MAX) {
+		r->rules[r->count++] = rule;
+	} else {
+		ret = -ENOSPC;
+	}
+	spin_unlock_irqrestore(&r->lock, flags);
+	return ret;
+}
+
+/*
+ * One line per rule: "<n> <src> <edge> <dst> <action> <ms> <fired>".
+ */
+ssize_t rulesShow(struct RulesBean *r, char *buf) {
+	struct RuleBean rules[RULES_MAX];
+	struct RuleBean *rule;
+	unsigned long flags;
+	unsigned int i, count;
+	ssize_t len = 0;
+
+	spin_lock_irqsave(&r->lock, flags);
+	count = r->count;
+	memcpy(rules, r->rules, count * sizeof(*rules));
+	spin_unlock_irqrestore(&r->lock, flags);
+
+	for (i = 0; i < count; i++) {
+		rule = &rules[i];
+		len += sprintf(buf + len, "%u %s %s %s %s %lu %llu\n", i,
+				ruleLineName(rule->src->gpio.name),
+				ruleEdgeNames[rule->edge], ruleLineName(rule->dst->name),
+				ruleActionNames[rule->action], rule->time_usec / 1000,
+				rule->fired);
+	}
+	return len;
+}
@@ -0,0 +1,60 @@
+#ifndef _SL_RULES_H
+#define _SL_RULES_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include "../gpio/gpio.h"
+
+#define RULES_MAX 16
+#define RULES_MAX_PULSE_MSEC 3600000
+
+enum RuleEdge {
+	RULE_EDGE_RISE,
+	RULE_EDGE_FALL,
+	RULE_EDGE_ANY,
+};
+
+enum RuleAction {
+	RULE_ACTION_ON,
+	RULE_ACTION_OFF,
+	RULE_ACTION_TOGGLE,
+	RULE_ACTION_PULSE,
+	RULE_ACTION_FOLLOW,
+};
+
+struct RuleBean {
+	struct DebouncedGpioBean *src;
+	enum RuleEdge edge;
+	struct GpioBean *dst;
+	enum RuleAction action;
+	unsigned long time_usec;
+	u64 fired;
+};
+
+/*
+ * Table of "on input change do output action" rules, evaluated from the
+ * debounce timer of the source input. sources and targets are the
+ * NULL-terminated lists of the lines that can be used, referred to by
+ * the part of their name after the last '_'.
+ */
+struct RulesBean {
+	spinlock_t lock;
+	struct RuleBean rules[RULES_MAX];
+	unsigned int count;
+	struct DebouncedGpioBean **sources;
+	struct GpioBean **targets;
+};
+
+void rulesInit(struct RulesBean *r, struct DebouncedGpioBean **sources,
+		struct GpioBean **targets);
+
+void rulesEval(struct RulesBean *r, struct DebouncedGpioBean *src, int prev,
+		int val);
+
+void rulesClear(struct RulesBean *r);
+
+int rulesParse(struct RulesBean *r, const char *buf);
+
+ssize_t rulesShow(struct RulesBean *r, char *buf);
+
+#endif
@@ -45,6 +45,7 @@
 
 /* all measurement commands return T (CRC) RH (CRC) */
 #define SHT4X_CMD_MEASURE_HPM 0xFD
+#define SHT4X_CMD_MEASURE_MPM 0xF6
 #define SHT4X_CMD_MEASURE_LPM 0xE0
 #define SHT4X_CMD_READ_SERIAL 0x89
 #define SHT4X_CMD_DURATION_USEC 1000
@@ -91,15 +92,31 @@ int16_t sht4x_probe(void) {
 }
 
 void sht4x_enable_low_power_mode(uint8_t enable_low_power_mode) {
-    if (enable_low_power_mode) {
-        sht4x_cmd_measure = SHT4X_CMD_MEASURE_LPM;
-        sht4x_cmd_measure_delay_us = SHT4X_MEASUREMENT_DURATION_LPM_USEC;
-    } else {
-        sht4x_cmd_measure = SHT4X_CMD_MEASURE_HPM;
-        sht4x_cmd_measure_delay_us = SHT4X_MEASUREMENT_DURATION_USEC;
+    sht4x_set_repeatability(enable_low_power_mode ? SHT4X_REPEATABILITY_LOW
+                                                  : SHT4X_REPEATABILITY_HIGH);
+}
+
+void sht4x_set_repeatability(uint8_t repeatability) {
+    switch (repeatability) {
+        case SHT4X_REPEATABILITY_LOW:
+            sht4x_cmd_measure = SHT4X_CMD_MEASURE_LPM;
+            sht4x_cmd_measure_delay_us = SHT4X_MEASUREMENT_DURATION_LPM_USEC;
+            break;
+        case SHT4X_REPEATABILITY_MEDIUM:
+            sht4x_cmd_measure = SHT4X_CMD_MEASURE_MPM;
+            sht4x_cmd_measure_delay_us = SHT4X_MEASUREMENT_DURATION_MPM_USEC;
+            break;
+        default:
+            sht4x_cmd_measure = SHT4X_CMD_MEASURE_HPM;
+            sht4x_cmd_measure_delay_us = SHT4X_MEASUREMENT_DURATION_USEC;
+            break;
     }
 }
 
+uint16_t sht4x_get_measurement_duration_usec(void) {
+    return sht4x_cmd_measure_delay_us;
+}
+
 int16_t sht4x_read_serial(uint32_t* serial) {
     const uint8_t cmd = SHT4X_CMD_READ_SERIAL;
     int16_t ret;
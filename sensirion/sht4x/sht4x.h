@@ -54,10 +54,17 @@ extern "C" {
 #define STATUS_CRC_FAIL (-2)
 #define STATUS_UNKNOWN_DEVICE (-3)
 #define SHT4X_MEASUREMENT_DURATION_USEC 10000 /* 10ms "high repeatability" */
+#define SHT4X_MEASUREMENT_DURATION_MPM_USEC \
+    5000 /* 5ms "medium repeatability"      \
+          */
 #define SHT4X_MEASUREMENT_DURATION_LPM_USEC \
     2500 /* 2.5ms "low repeatability"       \
           */
 
+#define SHT4X_REPEATABILITY_HIGH 0
+#define SHT4X_REPEATABILITY_MEDIUM 1
+#define SHT4X_REPEATABILITY_LOW 2
+
 /**
  * Detects if a sensor is connected by reading out the ID register.
  * If the sensor does not answer or if the answer is not the expected value,
@@ -113,6 +120,23 @@ int16_t sht4x_read(int32_t* temperature, int32_t* humidity);
  */
 void sht4x_enable_low_power_mode(uint8_t enable_low_power_mode);
 
+/**
+ * Set the repeatability (precision) of the subsequent measurements. Lower
+ * repeatability shortens the measurement duration.
+ *
+ * @param repeatability SHT4X_REPEATABILITY_HIGH, SHT4X_REPEATABILITY_MEDIUM or
+ *                      SHT4X_REPEATABILITY_LOW
+ */
+void sht4x_set_repeatability(uint8_t repeatability);
+
+/**
+ * Get the duration of a measurement with the configured repeatability, i.e.
+ * the minimum wait time between sht4x_measure() and sht4x_read().
+ *
+ * @return measurement duration in microseconds
+ */
+uint16_t sht4x_get_measurement_duration_usec(void);
+
 /**
  * Read out the serial number
  *
@@ -0,0 +1,65 @@
+#include "stats.h"
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+void statsHistInit(struct StatsHistBean *h, const char *name) {
+	h->name = name;
+	spin_lock_init(&h->lock);
+	statsHistReset(h);
+}
+
+void statsHistAdd(struct StatsHistBean *h, u64 val) {
+	unsigned int b;
+	unsigned long flags;
+
+	b = val == 0 ? 0 : ilog2(val) + 1;
+	if (b >= STATS_HIST_BUCKETS) {
+		b = STATS_HIST_BUCKETS - 1;
+	}
+
+	spin_lock_irqsave(&h->lock, flags);
+	if (h->data.count == 0 || val < h->data.min) {
+		h->data.min = val;
+	}
+	if (val > h->data.max) {
+		h->data.max = val;
+	}
+	h->data.count++;
+	h->data.sum += val;
+	h->data.buckets[b]++;
+	spin_unlock_irqrestore(&h->lock, flags);
+}
+
+void statsHistReset(struct StatsHistBean *h) {
+	unsigned long flags;
+
+	spin_lock_irqsave(&h->lock, flags);
+	memset(&h->data, 0, sizeof(h->data));
+	spin_unlock_irqrestore(&h->lock, flags);
+}
+
+void statsHistShow(struct seq_file *m, struct StatsHistBean *h,
+		const char *unit) {
+	struct StatsHistData c;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&h->lock, flags);
+	c = h->data;
+	spin_unlock_irqrestore(&h->lock, flags);
+
+	seq_printf(m, "%s [%s]: count=%llu min=%llu avg=%llu max=%llu\n", h->name,
+			unit, c.count, c.min, c.count ? div64_u64(c.sum, c.count) : 0,
+			c.max);
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		if (c.buckets[i] == 0) {
+			continue;
+		}
+		if (i == 0) {
+			seq_printf(m, "  %10u: %llu\n", 0, c.buckets[i]);
+		} else {
+			seq_printf(m, "  %10llu: %llu\n", 1ull << (i - 1), c.buckets[i]);
+		}
+	}
+}
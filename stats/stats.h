@@ -0,0 +1,37 @@
+#ifndef _SL_STATS_H
+#define _SL_STATS_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/seq_file.h>
+
+/*
+ * Bucket i counts the values v with 2^(i-1) <= v < 2^i, bucket 0 counts
+ * zeros, the last bucket also counts everything above its lower bound.
+ */
+#define STATS_HIST_BUCKETS 26
+
+struct StatsHistData {
+	u64 count;
+	u64 sum;
+	u64 min;
+	u64 max;
+	u64 buckets[STATS_HIST_BUCKETS];
+};
+
+struct StatsHistBean {
+	const char *name;
+	spinlock_t lock;
+	struct StatsHistData data;
+};
+
+void statsHistInit(struct StatsHistBean *h, const char *name);
+
+void statsHistAdd(struct StatsHistBean *h, u64 val);
+
+void statsHistReset(struct StatsHistBean *h);
+
+void statsHistShow(struct seq_file *m, struct StatsHistBean *h,
+		const char *unit);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Exo Sense Pi kernel module - user space interface
+ *
+ *     Copyright (C) 2020-2025 Sfera Labs S.r.l.
+ *
+ *     For information, visit https://www.sferalabs.cc
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * LICENSE.txt file for more details.
+ *
+ */
+
+#ifndef _UAPI_EXOSENSEPI_H
+#define _UAPI_EXOSENSEPI_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Record read from /dev/exosensepi_tha, one per THA sample.
+ * Units are the same as the tha/temp_rh_voc sysfs attribute.
+ */
+struct exosensepi_tha_record {
+	__u64 ts_ns; /* CLOCK_MONOTONIC timestamp */
+	__s32 t; /* raw temperature [°C/100] */
+	__s32 t_cal; /* calibrated temperature [°C/100] */
+	__s32 rh; /* raw relative humidity [%/100] */
+	__s32 rh_cal; /* calibrated relative humidity [%/100] */
+	__s32 dt; /* internal temperature variation factor */
+	__s32 voc_index; /* VOC index [0-500] */
+	__u16 sraw; /* raw VOC sensor value */
+	__u16 reserved;
+	__u32 seq; /* sample sequence number, starts from 1 */
+};
+
+/*
+ * Record read from /dev/exosensepi_di1, /dev/exosensepi_di2 and
+ * /dev/exosensepi_pir, one per change of the debounced value.
+ */
+struct exosensepi_gpio_event {
+	__u64 ts_ns; /* CLOCK_MONOTONIC time of the edge that led to the change */
+	__u64 edges; /* raw edges counted on the input up to the change */
+	__s32 value; /* new debounced value */
+	__u32 lost; /* events dropped before this one, buffer full */
+};
+
+#define EXOSENSEPI_WIEGAND_MAX_BITS 256
+#define EXOSENSEPI_WIEGAND_PIN_MAX 15
+
+/* exosensepi_wiegand_frame kinds */
+#define EXOSENSEPI_WIEGAND_FRAME 0 /* frame as received */
+#define EXOSENSEPI_WIEGAND_PIN 1 /* PIN assembled in keypad mode */
+
+/*
+ * Record read from /dev/exosensepi_wiegand, one per completed frame. Frames
+ * of a known format failing the parity check are not reported.
+ */
+struct exosensepi_wiegand_frame {
+	__u64 ts_ns; /* CLOCK_MONOTONIC_RAW time of the last bit */
+	__u32 bits; /* number of bits received */
+	__s32 noise; /* latest noise code when the frame ended, see README */
+	__u32 lost; /* frames dropped before this one, buffer full */
+	__u32 facility; /* facility code, 0 if the format has none */
+	__u64 card; /* card number */
+	char format[16]; /* name of the matching format, empty if none */
+	/* bits received, bit i (0 = first) is data[i / 8] & (0x80 >> (i % 8)) */
+	__u8 data[EXOSENSEPI_WIEGAND_MAX_BITS / 8];
+	__s32 access; /* allowlist result: 1 granted, 0 denied, -1 not checked */
+	__u32 kind; /* EXOSENSEPI_WIEGAND_FRAME or EXOSENSEPI_WIEGAND_PIN */
+	/*
+	 * PIN digits, NUL-terminated, for EXOSENSEPI_WIEGAND_PIN. In card+PIN
+	 * mode the other fields are those of the card read before the PIN, or
+	 * zero if none.
+	 */
+	char pin[EXOSENSEPI_WIEGAND_PIN_MAX + 1];
+};
+
+/*
+ * Allowlist entry, written to and read from /dev/exosensepi_wiegand_allow
+ * as an array of records. A decoded frame is granted if its facility code
+ * and card number match an entry.
+ */
+struct exosensepi_wiegand_card {
+	__u64 card;
+	__u32 facility;
+	__u32 reserved; /* must be 0 */
+};
+
+/*
+ * Raw edge recorded by the input capture, read from
+ * /sys/kernel/debug/exosensepi/capture_data.
+ */
+struct exosensepi_capture_edge {
+	__u64 ts_ns; /* CLOCK_MONOTONIC time of the edge interrupt */
+	__u32 value; /* line level read in the interrupt handler */
+	__u32 reserved;
+};
+
+/*
+ * Bits of the I/O lines in the exosensepi_io_state and exosensepi_io_outputs
+ * masks.
+ */
+#define EXOSENSEPI_IO_DI1 (1 << 0)
+#define EXOSENSEPI_IO_DI2 (1 << 1)
+#define EXOSENSEPI_IO_PIR (1 << 2)
+#define EXOSENSEPI_IO_TTL1 (1 << 3)
+#define EXOSENSEPI_IO_TTL2 (1 << 4)
+#define EXOSENSEPI_IO_DO1 (1 << 5)
+#define EXOSENSEPI_IO_LED (1 << 6)
+#define EXOSENSEPI_IO_BUZZ (1 << 7)
+
+/*
+ * State of all I/O lines, returned by EXOSENSEPI_IOC_GET_IO on
+ * /dev/exosensepi_io.
+ */
+struct exosensepi_io_state {
+	__u64 ts_ns; /* CLOCK_MONOTONIC time of the snapshot */
+	__u32 values; /* line levels, EXOSENSEPI_IO_* bits */
+	__u32 valid; /* lines whose level is available, EXOSENSEPI_IO_* bits */
+	__s32 di_deb[2]; /* DI1/DI2 debounced values, -1 undefined */
+	__s32 pir_deb; /* PIR debounced value, -1 undefined */
+	__u32 reserved;
+	__u64 di_on_cnt[2]; /* DI1/DI2 debounced on counters */
+	__u64 di_off_cnt[2]; /* DI1/DI2 debounced off counters */
+	__u64 di_pulse_cnt[2]; /* DI1/DI2 pulse counters */
+	__u64 pir_on_cnt; /* PIR on counter */
+};
+
+/*
+ * Sets the outputs selected by mask to the corresponding bits of values,
+ * with EXOSENSEPI_IOC_SET_OUTPUTS on /dev/exosensepi_io.
+ */
+struct exosensepi_io_outputs {
+	__u32 mask; /* EXOSENSEPI_IO_* bits */
+	__u32 values;
+};
+
+#define EXOSENSEPI_IOC_MAGIC 0xE5
+#define EXOSENSEPI_IOC_GET_IO _IOR(EXOSENSEPI_IOC_MAGIC, 1, \
+		struct exosensepi_io_state)
+#define EXOSENSEPI_IOC_SET_OUTPUTS _IOW(EXOSENSEPI_IOC_MAGIC, 2, \
+		struct exosensepi_io_outputs)
+
+/*
+ * Series kept in the /dev/exosensepi_history time-series buffers.
+ */
+enum exosensepi_history_series {
+	EXOSENSEPI_HISTORY_T_CAL = 0, /* calibrated temperature [°C/100] */
+	EXOSENSEPI_HISTORY_RH_CAL, /* calibrated relative humidity [%/100] */
+	EXOSENSEPI_HISTORY_VOC_INDEX, /* VOC index [0-500] */
+	EXOSENSEPI_HISTORY_LUX, /* light intensity [lx/100] */
+	EXOSENSEPI_HISTORY_PIR, /* PIR status [0-1] */
+	EXOSENSEPI_HISTORY_SOUND_LEQ, /* sound_eval period LEQ */
+	EXOSENSEPI_HISTORY_SERIES,
+};
+
+/*
+ * Query written to /dev/exosensepi_history. Selects the buckets of the
+ * given series and resolution level starting in [from, to), Unix time in
+ * seconds.
+ */
+struct exosensepi_history_query {
+	__u32 series; /* enum exosensepi_history_series */
+	__u32 level; /* 0: 1 s, 1: 1 min, 2: 1 h */
+	__s64 from;
+	__s64 to;
+};
+
+/*
+ * Record read from /dev/exosensepi_history, one per bucket, oldest first.
+ * The average is sum / count.
+ */
+struct exosensepi_history_point {
+	__s64 ts; /* bucket start, Unix time in seconds */
+	__s64 sum;
+	__s32 min;
+	__s32 max;
+	__u32 count; /* number of samples in the bucket */
+	__u32 period; /* bucket length in seconds */
+};
+
+#endif
@@ -1,21 +1,386 @@
 #include "wiegand.h"
 #include "../commons/commons.h"
 #include <linux/interrupt.h>
-
-#define WIEGAND_MAX_BITS 64
+#include <linux/bitops.h>
+#include <linux/bsearch.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
 
 int wCount = 0;
 
+static const char *wiegandStdFormats[] = {
+	"H10301 26 1 8 9 16 e:3ffe000 o:1fff",
+	"H10306 34 1 16 17 16 e:3fffe0000 o:1ffff",
+	"C1000-35 35 2 12 14 20 e:3b6db6db6 o:36db6db6d o:7ffffffff",
+	"H10304 37 1 16 17 19 e:1ffffc0000 o:7ffff",
+	"C1000-48 48 2 22 24 23 e:76db6db6db6c o:6db6db6db6db o:ffffffffffff",
+};
+
+static int wiegandFormatParse(struct WiegandFormat *fmt, const char *buf);
+
+static void wiegandFormatsReset(struct WiegandBean *w) {
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(wiegandStdFormats); i++) {
+		wiegandFormatParse(&w->formats[i], wiegandStdFormats[i]);
+	}
+	w->formatsCount = ARRAY_SIZE(wiegandStdFormats);
+}
+
+/*
+ * Writes the n bits as a hex number, the last bit received being the
+ * least significant one. Returns the number of digits.
+ */
+static unsigned int wiegandHex(char *buf, const u8 *bits, unsigned int n) {
+	unsigned int digits = DIV_ROUND_UP(n, 4);
+	unsigned int pad = digits * 4 - n;
+	unsigned int d, j, pos, nib;
+
+	for (d = 0; d < digits; d++) {
+		nib = 0;
+		for (j = 0; j < 4; j++) {
+			pos = d * 4 + j;
+			nib <<= 1;
+			if (pos >= pad && wiegandBit(bits, pos - pad)) {
+				nib |= 1;
+			}
+		}
+		buf[d] = hex_asc[nib];
+	}
+	buf[digits] = '\0';
+	return digits;
+}
+
+/*
+ * Sets the n-bit mask from a hex number aligned as wiegandHex() writes it.
+ */
+static int wiegandMaskParse(u8 *mask, unsigned int n, const char *hex) {
+	size_t len = strlen(hex);
+	unsigned int k, j, vbit;
+	int d;
+
+	memset(mask, 0, WIEGAND_MAX_BITS / 8);
+	for (k = 0; k < len; k++) {
+		d = hex_to_bin(hex[len - 1 - k]);
+		if (d < 0) {
+			return -EINVAL;
+		}
+		for (j = 0; j < 4; j++) {
+			if (d & (1 << j)) {
+				vbit = k * 4 + j;
+				if (vbit >= n) {
+					return -EINVAL;
+				}
+				mask[(n - 1 - vbit) / 8] |= 0x80 >> ((n - 1 - vbit) % 8);
+			}
+		}
+	}
+	return 0;
+}
+
+static uint64_t wiegandField(const u8 *bits, unsigned int offset,
+		unsigned int len) {
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = offset; i < offset + len; i++) {
+		v = (v << 1) | (wiegandBit(bits, i) ? 1 : 0);
+	}
+	return v;
+}
+
+static bool wiegandParityOk(const struct WiegandFormat *fmt, const u8 *bits) {
+	unsigned int i, k, weight;
+
+	for (i = 0; i < fmt->parityCount; i++) {
+		weight = 0;
+		for (k = 0; k < DIV_ROUND_UP(fmt->bits, 8); k++) {
+			weight += hweight8(bits[k] & fmt->parity[i].mask[k]);
+		}
+		if ((weight & 1) != (fmt->parity[i].odd ? 1 : 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Fills the decoded fields of f with the first format of its length whose
+ * parity checks pass. Returns -EBADMSG if formats of its length exist but
+ * none passes, 0 otherwise. Called with the lock held.
+ */
+static int wiegandDecode(struct WiegandBean *w,
+		struct exosensepi_wiegand_frame *f) {
+	const struct WiegandFormat *fmt;
+	bool lengthMatch = false;
+	unsigned int i;
+
+	f->facility = 0;
+	f->card = 0;
+	f->format[0] = '\0';
+	for (i = 0; i < w->formatsCount; i++) {
+		fmt = &w->formats[i];
+		if (fmt->bits != f->bits) {
+			continue;
+		}
+		lengthMatch = true;
+		if (wiegandParityOk(fmt, f->data)) {
+			f->facility = wiegandField(f->data, fmt->facilityOffset,
+					fmt->facilityLen);
+			f->card = wiegandField(f->data, fmt->cardOffset, fmt->cardLen);
+			strscpy_pad(f->format, fmt->name, sizeof(f->format));
+			return 0;
+		}
+	}
+	return lengthMatch ? -EBADMSG : 0;
+}
+
+static int wiegandCardCmp(const void *a, const void *b) {
+	const struct exosensepi_wiegand_card *x = a;
+	const struct exosensepi_wiegand_card *y = b;
+
+	if (x->facility != y->facility) {
+		return x->facility < y->facility ? -1 : 1;
+	}
+	if (x->card != y->card) {
+		return x->card < y->card ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Looks up a decoded frame in the allowlist, if loaded, and pulses the
+ * grant or deny output. The binary search keeps the time spent here
+ * logarithmic in the size of the list.
+ */
+static void wiegandAccess(struct WiegandBean *w,
+		struct exosensepi_wiegand_frame *f) {
+	struct exosensepi_wiegand_card key;
+	struct WiegandAllowList *list;
+	struct WiegandAction *a;
+
+	f->access = -1;
+	if (f->format[0] == '\0') {
+		return;
+	}
+	key.card = f->card;
+	key.facility = f->facility;
+	key.reserved = 0;
+
+	rcu_read_lock();
+	list = rcu_dereference(w->allow);
+	if (list != NULL) {
+		f->access = bsearch(&key, list->cards, list->count, sizeof(key),
+				wiegandCardCmp) != NULL ? 1 : 0;
+	}
+	rcu_read_unlock();
+
+	if (f->access < 0) {
+		return;
+	}
+	a = f->access ? &w->grant : &w->deny;
+	if (a->gpio != NULL) {
+		gpioOutputAtomic(a->gpio, 1, a->pulse_usec);
+	}
+}
+
+/*
+ * Called with the lock held.
+ */
+static void wiegandFrameQueue(struct WiegandBean *w,
+		struct exosensepi_wiegand_frame *f) {
+	if (kfifo_is_full(&w->frames)) {
+		// drop the oldest frame
+		kfifo_skip(&w->frames);
+		w->framesLost++;
+	}
+	f->lost = w->framesLost;
+	w->framesLost = 0;
+	kfifo_put(&w->frames, *f);
+
+	wake_up_interruptible(&w->framesWq);
+}
+
+/*
+ * Returns the key of a 4-bit keypad frame, or of an 8-bit one whose high
+ * nibble is the complement of the low one: 0-9, 10 for '*', 11 for '#'.
+ * Returns -1 for other frames.
+ */
+static int wiegandKey(struct exosensepi_wiegand_frame *f) {
+	unsigned int key;
+
+	if (f->bits == 4) {
+		key = f->data[0] >> 4;
+	} else if (f->bits == 8 && (f->data[0] >> 4) == (~f->data[0] & 0xf)) {
+		key = f->data[0] & 0xf;
+	} else {
+		return -1;
+	}
+	return key <= 11 ? key : -1;
+}
+
+static void wiegandPinClear(struct WiegandBean *w) {
+	w->pinLen = 0;
+	w->pinCardValid = false;
+}
+
+/*
+ * Queues the PIN entered, with the card read before it in card+PIN mode,
+ * or the card alone if no digit followed. Called with the lock held.
+ */
+static void wiegandPinEmit(struct WiegandBean *w) {
+	struct exosensepi_wiegand_frame f;
+
+	if (w->pinCardValid) {
+		f = w->pinCard;
+	} else if (w->pinLen > 0) {
+		memset(&f, 0, sizeof(f));
+		f.access = -1;
+	} else {
+		return;
+	}
+	f.noise = w->noise;
+	if (w->pinLen > 0) {
+		f.kind = EXOSENSEPI_WIEGAND_PIN;
+		f.ts_ns = w->pinTs;
+		memcpy(f.pin, w->pin, w->pinLen);
+		f.pin[w->pinLen] = '\0';
+		w->lastPin = f;
+		w->pinNotify = true;
+	} else {
+		w->last = f;
+	}
+	wiegandFrameQueue(w, &f);
+	wiegandPinClear(w);
+}
+
+static void wiegandKeypadTimerRestart(struct WiegandBean *w) {
+	w->pinDeadline = ktime_add_us(ktime_get(), w->keypadTimeout_usec);
+	hrtimer_start(&w->keypadTimer, ns_to_ktime(w->keypadTimeout_usec * 1000),
+			HRTIMER_MODE_REL);
+}
+
+/*
+ * Handles a decoded frame in keypad mode. Returns true if the frame was
+ * taken, false if it must be reported as is. Called with the lock held.
+ */
+static bool wiegandKeypad(struct WiegandBean *w,
+		struct exosensepi_wiegand_frame *f) {
+	int key = wiegandKey(f);
+
+	if (key < 0) {
+		if (w->keypad != WIEGAND_KEYPAD_CARD_PIN || f->format[0] == '\0') {
+			return false;
+		}
+		// hold the card until its PIN is entered
+		wiegandPinEmit(w);
+		w->pinCard = *f;
+		w->pinCard.access = -1;
+		w->pinCardValid = true;
+		wiegandKeypadTimerRestart(w);
+		return true;
+	}
+
+	if (key == 10) {
+		// '*'
+		w->pinLen = 0;
+	} else if (key == 11) {
+		// '#'
+		wiegandPinEmit(w);
+	} else {
+		w->pin[w->pinLen++] = '0' + key;
+		w->pinTs = f->ts_ns;
+		if (w->pinLen >= w->keypadMaxLen) {
+			wiegandPinEmit(w);
+		}
+	}
+	if (w->pinLen > 0 || w->pinCardValid) {
+		wiegandKeypadTimerRestart(w);
+	}
+	return true;
+}
+
+static enum hrtimer_restart wiegandKeypadTimerHandler(struct hrtimer *tmr) {
+	struct WiegandBean *w;
+	unsigned long flags;
+	bool notify = false;
+	w = container_of(tmr, struct WiegandBean, keypadTimer);
+
+	spin_lock_irqsave(&w->lock, flags);
+	// a key may have restarted the timer while we waited for the lock
+	if (!ktime_before(ktime_get(), w->pinDeadline)) {
+		wiegandPinEmit(w);
+		notify = w->pinNotify;
+		w->pinNotify = false;
+	}
+	spin_unlock_irqrestore(&w->lock, flags);
+
+	if (notify && w->pinNotifKn != NULL) {
+		sysfs_notify_dirent(w->pinNotifKn);
+	}
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Decodes and queues the frame being received, unless already done.
+ * Frames failing the parity check are dropped and reported as noise.
+ * Returns true if the frame was queued. Called with the lock held.
+ */
+static bool wiegandFramePush(struct WiegandBean *w) {
+	struct exosensepi_wiegand_frame f;
+
+	if (w->bitCount == 0 || w->framePushed) {
+		return false;
+	}
+	w->framePushed = true;
+
+	// the whole record is copied to userspace, padding included
+	memset(&f, 0, sizeof(f));
+	f.ts_ns = timespec64_to_ns(&w->lastBitTs);
+	memcpy(f.data, w->data, sizeof(f.data));
+	f.bits = w->bitCount;
+	f.kind = EXOSENSEPI_WIEGAND_FRAME;
+	if (wiegandDecode(w, &f) < 0) {
+		w->noise = 16;
+		return false;
+	}
+	if (w->keypad != WIEGAND_KEYPAD_OFF && wiegandKeypad(w, &f)) {
+		return false;
+	}
+	wiegandAccess(w, &f);
+	f.noise = w->noise;
+	w->last = f;
+	wiegandFrameQueue(w, &f);
+	return true;
+}
+
 static enum hrtimer_restart wiegandTimerHandler(struct hrtimer *tmr) {
 	struct WiegandBean *w;
+	unsigned long flags;
+	bool queued, notifyPin;
 	w = container_of(tmr, struct WiegandBean, timer);
-	if (w->notifKn != NULL) {
+
+	spin_lock_irqsave(&w->lock, flags);
+	queued = wiegandFramePush(w);
+	notifyPin = w->pinNotify;
+	w->pinNotify = false;
+	spin_unlock_irqrestore(&w->lock, flags);
+
+	if (queued && w->notifKn != NULL) {
 		sysfs_notify_dirent(w->notifKn);
 	}
+	if (notifyPin && w->pinNotifKn != NULL) {
+		sysfs_notify_dirent(w->pinNotifKn);
+	}
 	return HRTIMER_NORESTART;
 }
 
-void wiegandInit(struct WiegandBean *w) {
+int wiegandInit(struct WiegandBean *w) {
 	w->d0.irqRequested = false;
 	w->d1.irqRequested = false;
 	w->enabled = false;
@@ -25,14 +390,44 @@ void wiegandInit(struct WiegandBean *w) {
 	w->pulseIntervalMax_usec = 2700;
 	w->noise = 0;
 	w->id = '0' + (++wCount);
+	spin_lock_init(&w->lock);
+	w->bitCount = 0;
+	w->framePushed = false;
+	w->framesLost = 0;
+	memset(&w->last, 0, sizeof(w->last));
+	wiegandFormatsReset(w);
+	init_waitqueue_head(&w->framesWq);
+	w->miscRegistered = false;
+	RCU_INIT_POINTER(w->allow, NULL);
+	mutex_init(&w->allowLock);
+	w->grant.gpio = NULL;
+	w->deny.gpio = NULL;
+	w->allowMiscRegistered = false;
+	w->keypad = WIEGAND_KEYPAD_OFF;
+	w->keypadTimeout_usec = WIEGAND_KEYPAD_TIMEOUT_DEFAULT_USEC;
+	w->keypadMaxLen = EXOSENSEPI_WIEGAND_PIN_MAX;
+	w->pinNotify = false;
+	wiegandPinClear(w);
+	memset(&w->lastPin, 0, sizeof(w->lastPin));
+	hrtimer_init(&w->keypadTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	w->keypadTimer.function = &wiegandKeypadTimerHandler;
 	hrtimer_init(&w->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	w->timer.function = &wiegandTimerHandler;
+	return kfifo_alloc(&w->frames, WIEGAND_FRAMES_SIZE, GFP_KERNEL);
+}
+
+void wiegandFree(struct WiegandBean *w) {
+	kfifo_free(&w->frames);
+	// no more readers once the IRQs, the timer and the devices are gone
+	kvfree(rcu_dereference_protected(w->allow, 1));
+	RCU_INIT_POINTER(w->allow, NULL);
 }
 
 static void wiegandReset(struct WiegandBean *w) {
 	w->enabled = true;
-	w->data = 0;
+	memset(w->data, 0, sizeof(w->data));
 	w->bitCount = 0;
+	w->framePushed = false;
 	w->activeLine = NULL;
 	w->d0.wasLow = false;
 	w->d1.wasLow = false;
@@ -41,6 +436,7 @@ static void wiegandReset(struct WiegandBean *w) {
 void wiegandDisable(struct WiegandBean *w) {
 	if (w->enabled) {
 		hrtimer_cancel(&w->timer);
+		hrtimer_cancel(&w->keypadTimer);
 
 		gpioFree(w->d0.gpio);
 		gpioFree(w->d1.gpio);
@@ -61,27 +457,13 @@ void wiegandDisable(struct WiegandBean *w) {
 	}
 }
 
-static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
+/*
+ * Handles a level change of line l. Called with the lock held.
+ */
+static void wiegandLineChange(struct WiegandBean *w, struct WiegandLine *l) {
 	bool isLow;
 	struct timespec64 now;
 	unsigned long long diff;
-	struct WiegandBean *w;
-	struct WiegandLine *l;
-
-	w = (struct WiegandBean*) dev;
-	l = NULL;
-
-	if (w->enabled) {
-		if (irq == w->d0.irq) {
-			l = &w->d0;
-		} else if (irq == w->d1.irq) {
-			l = &w->d1;
-		}
-	}
-
-	if (l == NULL) {
-		return IRQ_HANDLED;
-	}
 
 	isLow = gpioGetVal(l->gpio) == 0;
 
@@ -92,7 +474,7 @@ static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
 		if (w->noise == 0) {
 			w->noise = 10;
 		}
-		return IRQ_HANDLED;
+		return;
 	}
 
 	l->wasLow = isLow;
@@ -108,7 +490,9 @@ static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
 			}
 
 			if (diff > w->pulseIntervalMax_usec) {
-				w->data = 0;
+				// in case the timer has not run yet
+				wiegandFramePush(w);
+				memset(w->data, 0, sizeof(w->data));
 				w->bitCount = 0;
 			}
 		}
@@ -134,7 +518,7 @@ static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
 		w->activeLine = NULL;
 
 		if (w->bitCount >= WIEGAND_MAX_BITS) {
-			return IRQ_HANDLED;
+			return;
 		}
 
 		diff = diff_usec((struct timespec64*) &(w->lastBitTs), &now);
@@ -149,22 +533,47 @@ static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
 			goto noise;
 		}
 
-		w->data <<= 1;
 		if (l == &w->d1) {
-			w->data |= 1;
+			w->data[w->bitCount / 8] |= 0x80 >> (w->bitCount % 8);
 		}
 		w->bitCount++;
+		w->framePushed = false;
 
-		hrtimer_cancel(&w->timer);
+		// restarts the timer if pending, the handler takes the lock
 		hrtimer_start(&w->timer,
 				ktime_set(0, (w->pulseIntervalMax_usec - diff) * 1000),
 				HRTIMER_MODE_REL);
 	}
 
-	return IRQ_HANDLED;
+	return;
 
 	noise:
 	wiegandReset(w);
+}
+
+static irqreturn_t wiegandDataIrqHandler(int irq, void *dev) {
+	struct WiegandBean *w;
+	struct WiegandLine *l;
+
+	w = (struct WiegandBean*) dev;
+	l = NULL;
+
+	if (w->enabled) {
+		if (irq == w->d0.irq) {
+			l = &w->d0;
+		} else if (irq == w->d1.irq) {
+			l = &w->d1;
+		}
+	}
+
+	if (l == NULL) {
+		return IRQ_HANDLED;
+	}
+
+	spin_lock(&w->lock);
+	wiegandLineChange(w, l);
+	spin_unlock(&w->lock);
+
 	return IRQ_HANDLED;
 }
 
@@ -249,8 +658,11 @@ ssize_t devAttrWiegandEnabled_store(struct device *dev,
 	}
 
 	if (enable) {
+		spin_lock_irq(&w->lock);
 		w->noise = 0;
 		wiegandReset(w);
+		wiegandPinClear(w);
+		spin_unlock_irq(&w->lock);
 	} else {
 		wiegandDisable(w);
 	}
@@ -261,11 +673,21 @@ ssize_t devAttrWiegandEnabled_store(struct device *dev,
 	return count;
 }
 
-ssize_t devAttrWiegandData_show(struct device *dev,
-		struct device_attribute *attr, char *buf) {
+enum WiegandDataForm {
+	WIEGAND_DATA_DEC,
+	WIEGAND_DATA_HEX,
+	WIEGAND_DATA_BIN,
+};
+
+static ssize_t wiegandDataShow(struct device *dev,
+		struct device_attribute *attr, char *buf, enum WiegandDataForm form) {
+	struct exosensepi_wiegand_frame f;
 	struct timespec64 now;
 	unsigned long long diff;
 	struct WiegandBean *w;
+	ssize_t len;
+	uint64_t val;
+	unsigned int i;
 	w = wiegandGetBean(dev, attr);
 	if (w == NULL) {
 		return -EFAULT;
@@ -275,7 +697,7 @@ ssize_t devAttrWiegandData_show(struct device *dev,
 		return -ENODEV;
 	}
 
-	if (w->notifKn == NULL) {
+	if (form == WIEGAND_DATA_DEC && w->notifKn == NULL) {
 		w->notifKn = sysfs_get_dirent(dev->kobj.sd, attr->attr.name);
 	}
 
@@ -285,8 +707,465 @@ ssize_t devAttrWiegandData_show(struct device *dev,
 		return -EBUSY;
 	}
 
-	return sprintf(buf, "%llu %d %llu\n", to_usec(&w->lastBitTs), w->bitCount,
-			w->data);
+	spin_lock_irq(&w->lock);
+	f = w->last;
+	spin_unlock_irq(&w->lock);
+
+	len = sprintf(buf, "%llu %u ", div_u64(f.ts_ns, NSEC_PER_USEC), f.bits);
+	switch (form) {
+	case WIEGAND_DATA_HEX:
+		len += wiegandHex(buf + len, f.data, f.bits);
+		break;
+	case WIEGAND_DATA_BIN:
+		for (i = 0; i < f.bits; i++) {
+			buf[len++] = wiegandBit(f.data, i) ? '1' : '0';
+		}
+		break;
+	default:
+		// the last 64 bits only
+		val = wiegandField(f.data, f.bits > 64 ? f.bits - 64 : 0,
+				f.bits > 64 ? 64 : f.bits);
+		len += sprintf(buf + len, "%llu", val);
+		break;
+	}
+	buf[len++] = '\n';
+
+	return len;
+}
+
+ssize_t devAttrWiegandData_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	return wiegandDataShow(dev, attr, buf, WIEGAND_DATA_DEC);
+}
+
+ssize_t devAttrWiegandDataHex_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	return wiegandDataShow(dev, attr, buf, WIEGAND_DATA_HEX);
+}
+
+ssize_t devAttrWiegandDataBin_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	return wiegandDataShow(dev, attr, buf, WIEGAND_DATA_BIN);
+}
+
+ssize_t devAttrWiegandCard_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct exosensepi_wiegand_frame f;
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	if (!w->enabled) {
+		return -ENODEV;
+	}
+
+	spin_lock_irq(&w->lock);
+	f = w->last;
+	spin_unlock_irq(&w->lock);
+
+	if (f.format[0] == '\0') {
+		return -ENODATA;
+	}
+	return sprintf(buf, "%llu %s %u %llu\n", div_u64(f.ts_ns, NSEC_PER_USEC),
+			f.format, f.facility, f.card);
+}
+
+ssize_t devAttrWiegandFormats_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	char hex[WIEGAND_MAX_BITS / 4 + 1];
+	struct WiegandFormat *fmts;
+	struct WiegandFormat *fmt;
+	struct WiegandBean *w;
+	unsigned int i, j, count;
+	ssize_t len = 0;
+
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+	fmts = kmalloc(sizeof(w->formats), GFP_KERNEL);
+	if (fmts == NULL) {
+		return -ENOMEM;
+	}
+
+	spin_lock_irq(&w->lock);
+	count = w->formatsCount;
+	memcpy(fmts, w->formats, count * sizeof(*fmts));
+	spin_unlock_irq(&w->lock);
+
+	for (i = 0; i < count; i++) {
+		fmt = &fmts[i];
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s %u %u %u %u %u",
+				fmt->name, fmt->bits, fmt->facilityOffset, fmt->facilityLen,
+				fmt->cardOffset, fmt->cardLen);
+		for (j = 0; j < fmt->parityCount; j++) {
+			wiegandHex(hex, fmt->parity[j].mask, fmt->bits);
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %c:%s",
+					fmt->parity[j].odd ? 'o' : 'e', hex);
+		}
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	kfree(fmts);
+
+	return len;
+}
+
+/*
+ * Parses "<name> <bits> <fcOffset> <fcLen> <cardOffset> <cardLen>
+ * [<e|o>:<mask>]...", with up to WIEGAND_FORMAT_PARITIES parity checks.
+ */
+static int wiegandFormatParse(struct WiegandFormat *fmt, const char *buf) {
+	char type[WIEGAND_FORMAT_PARITIES];
+	char mask[WIEGAND_FORMAT_PARITIES][WIEGAND_MAX_BITS / 4 + 1];
+	unsigned int i;
+	int n;
+
+	n = sscanf(buf, "%15s %u %u %u %u %u %c:%64s %c:%64s %c:%64s", fmt->name,
+			&fmt->bits, &fmt->facilityOffset, &fmt->facilityLen,
+			&fmt->cardOffset, &fmt->cardLen, &type[0], mask[0], &type[1],
+			mask[1], &type[2], mask[2]);
+	if (n < 6 || n % 2 != 0) {
+		return -EINVAL;
+	}
+	if (fmt->bits == 0 || fmt->bits > WIEGAND_MAX_BITS
+			|| fmt->facilityLen > 32 || fmt->cardLen > 64
+			|| fmt->facilityOffset + fmt->facilityLen > fmt->bits
+			|| fmt->cardOffset + fmt->cardLen > fmt->bits) {
+		return -EINVAL;
+	}
+	fmt->parityCount = (n - 6) / 2;
+	for (i = 0; i < fmt->parityCount; i++) {
+		if (type[i] != 'e' && type[i] != 'o') {
+			return -EINVAL;
+		}
+		if (wiegandMaskParse(fmt->parity[i].mask, fmt->bits, mask[i])) {
+			return -EINVAL;
+		}
+		fmt->parity[i].odd = type[i] == 'o';
+	}
+	return 0;
+}
+
+/*
+ * A format written is tried before the existing ones; "del <name>"
+ * removes one and "reset" restores the standard ones.
+ */
+ssize_t devAttrWiegandFormats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct WiegandFormat fmt;
+	struct WiegandBean *w;
+	char name[WIEGAND_FORMAT_NAME_LEN];
+	unsigned int i;
+	int ret = -EINVAL;
+
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	if (sysfs_streq(buf, "reset")) {
+		spin_lock_irq(&w->lock);
+		wiegandFormatsReset(w);
+		spin_unlock_irq(&w->lock);
+		return count;
+	}
+
+	if (sscanf(buf, "del %15s", name) == 1) {
+		spin_lock_irq(&w->lock);
+		for (i = 0; i < w->formatsCount; i++) {
+			if (strcmp(w->formats[i].name, name) == 0) {
+				memmove(&w->formats[i], &w->formats[i + 1],
+						(w->formatsCount - i - 1) * sizeof(fmt));
+				w->formatsCount--;
+				ret = 0;
+				break;
+			}
+		}
+		spin_unlock_irq(&w->lock);
+		return ret < 0 ? ret : count;
+	}
+
+	memset(&fmt, 0, sizeof(fmt));
+	ret = wiegandFormatParse(&fmt, buf);
+	if (ret < 0) {
+		return ret;
+	}
+
+	spin_lock_irq(&w->lock);
+	if (w->formatsCount < WIEGAND_FORMATS_MAX) {
+		memmove(&w->formats[1], &w->formats[0],
+				w->formatsCount * sizeof(fmt));
+		w->formats[0] = fmt;
+		w->formatsCount++;
+	} else {
+		ret = -ENOSPC;
+	}
+	spin_unlock_irq(&w->lock);
+
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+
+ssize_t devAttrWiegandAllowCount_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandAllowList *list;
+	struct WiegandBean *w;
+	unsigned int count = 0;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	rcu_read_lock();
+	list = rcu_dereference(w->allow);
+	if (list != NULL) {
+		count = list->count;
+	}
+	rcu_read_unlock();
+
+	return sprintf(buf, "%u\n", count);
+}
+
+static const char* wiegandOutputName(struct GpioBean *g) {
+	const char *s = strrchr(g->name, '_');
+	return s == NULL ? g->name : s + 1;
+}
+
+static ssize_t wiegandActionShow(struct WiegandBean *w, struct WiegandAction *a,
+		char *buf) {
+	struct GpioBean *g;
+	unsigned long pulse_usec;
+
+	spin_lock_irq(&w->lock);
+	g = a->gpio;
+	pulse_usec = a->pulse_usec;
+	spin_unlock_irq(&w->lock);
+
+	if (g == NULL) {
+		return sprintf(buf, "none\n");
+	}
+	return sprintf(buf, "%s %lu\n", wiegandOutputName(g), pulse_usec / 1000);
+}
+
+/*
+ * Accepts "<output> <ms>" or "none".
+ */
+static ssize_t wiegandActionStore(struct WiegandBean *w,
+		struct WiegandAction *a, const char *buf, size_t count) {
+	struct GpioBean *g = NULL;
+	char name[8];
+	unsigned int ms = 0;
+	int i;
+
+	if (!sysfs_streq(buf, "none")) {
+		if (sscanf(buf, "%7s %u", name, &ms) != 2 || ms == 0
+				|| ms > WIEGAND_ACTION_MAX_MSEC) {
+			return -EINVAL;
+		}
+		for (i = 0; w->outputs != NULL && w->outputs[i] != NULL; i++) {
+			if (strcmp(wiegandOutputName(w->outputs[i]), name) == 0) {
+				g = w->outputs[i];
+			}
+		}
+		if (g == NULL) {
+			return -EINVAL;
+		}
+	}
+
+	spin_lock_irq(&w->lock);
+	a->gpio = g;
+	a->pulse_usec = ms * 1000ul;
+	spin_unlock_irq(&w->lock);
+
+	return count;
+}
+
+ssize_t devAttrWiegandGrantAction_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+	return wiegandActionShow(w, &w->grant, buf);
+}
+
+ssize_t devAttrWiegandGrantAction_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+	return wiegandActionStore(w, &w->grant, buf, count);
+}
+
+ssize_t devAttrWiegandDenyAction_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+	return wiegandActionShow(w, &w->deny, buf);
+}
+
+ssize_t devAttrWiegandDenyAction_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+	return wiegandActionStore(w, &w->deny, buf, count);
+}
+
+ssize_t devAttrWiegandKeypad_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	return sprintf(buf, "%d\n", w->keypad);
+}
+
+ssize_t devAttrWiegandKeypad_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
+	int val;
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	ret = kstrtoint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val < WIEGAND_KEYPAD_OFF || val > WIEGAND_KEYPAD_CARD_PIN) {
+		return -EINVAL;
+	}
+
+	spin_lock_irq(&w->lock);
+	w->keypad = val;
+	wiegandPinClear(w);
+	spin_unlock_irq(&w->lock);
+
+	return count;
+}
+
+ssize_t devAttrWiegandKeypadTimeout_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	return sprintf(buf, "%lu\n", w->keypadTimeout_usec / 1000);
+}
+
+ssize_t devAttrWiegandKeypadTimeout_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
+	unsigned long val;
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val < 1 || val > WIEGAND_ACTION_MAX_MSEC) {
+		return -EINVAL;
+	}
+
+	w->keypadTimeout_usec = val * 1000;
+
+	return count;
+}
+
+ssize_t devAttrWiegandKeypadMaxLen_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	return sprintf(buf, "%u\n", w->keypadMaxLen);
+}
+
+ssize_t devAttrWiegandKeypadMaxLen_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	int ret;
+	unsigned int val;
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret < 0) {
+		return ret;
+	}
+	if (val < 1 || val > EXOSENSEPI_WIEGAND_PIN_MAX) {
+		return -EINVAL;
+	}
+
+	spin_lock_irq(&w->lock);
+	w->keypadMaxLen = val;
+	// an entry longer than the new limit is dropped
+	if (w->pinLen >= val) {
+		w->pinLen = 0;
+	}
+	spin_unlock_irq(&w->lock);
+
+	return count;
+}
+
+ssize_t devAttrWiegandPin_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct exosensepi_wiegand_frame f;
+	struct WiegandBean *w;
+	w = wiegandGetBean(dev, attr);
+	if (w == NULL) {
+		return -EFAULT;
+	}
+
+	if (!w->enabled) {
+		return -ENODEV;
+	}
+
+	if (w->pinNotifKn == NULL) {
+		w->pinNotifKn = sysfs_get_dirent(dev->kobj.sd, attr->attr.name);
+	}
+
+	spin_lock_irq(&w->lock);
+	f = w->lastPin;
+	spin_unlock_irq(&w->lock);
+
+	if (f.pin[0] == '\0') {
+		return -ENODATA;
+	}
+	if (f.format[0] == '\0') {
+		return sprintf(buf, "%llu %s - 0 0\n",
+				div_u64(f.ts_ns, NSEC_PER_USEC), f.pin);
+	}
+	return sprintf(buf, "%llu %s %s %u %llu\n",
+			div_u64(f.ts_ns, NSEC_PER_USEC), f.pin, f.format, f.facility,
+			f.card);
 }
 
 ssize_t devAttrWiegandNoise_show(struct device *dev,
@@ -427,3 +1306,296 @@ ssize_t devAttrWiegandPulseWidthMax_store(struct device *dev,
 
 	return count;
 }
+
+static int wiegandFramesOpen(struct inode *inode, struct file *file) {
+	struct WiegandBean *w;
+
+	w = container_of(file->private_data, struct WiegandBean, misc);
+	file->private_data = w;
+	return nonseekable_open(inode, file);
+}
+
+/*
+ * Returns as many whole frames as fit in the buffer, blocking until at
+ * least one is available unless O_NONBLOCK is set. Frames are removed from
+ * the buffer, so each one is delivered once.
+ */
+static ssize_t wiegandFramesRead(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct WiegandBean *w = file->private_data;
+	struct exosensepi_wiegand_frame batch[8];
+	unsigned long flags;
+	unsigned int n;
+	ssize_t copied = 0;
+
+	if (count < sizeof(batch[0])) {
+		return -EINVAL;
+	}
+
+	while (kfifo_is_empty(&w->frames)) {
+		if (file->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		if (wait_event_interruptible(w->framesWq,
+				!kfifo_is_empty(&w->frames))) {
+			return -ERESTARTSYS;
+		}
+	}
+
+	while (count - copied >= sizeof(batch[0])) {
+		n = min_t(size_t, ARRAY_SIZE(batch),
+				(count - copied) / sizeof(batch[0]));
+		// copy_to_user() may fault, so it cannot run under the spinlock
+		spin_lock_irqsave(&w->lock, flags);
+		n = kfifo_out(&w->frames, batch, n);
+		spin_unlock_irqrestore(&w->lock, flags);
+		if (n == 0) {
+			break;
+		}
+		if (copy_to_user(buf + copied, batch, n * sizeof(batch[0]))) {
+			return -EFAULT;
+		}
+		copied += n * sizeof(batch[0]);
+	}
+
+	return copied;
+}
+
+static __poll_t wiegandFramesPoll(struct file *file, poll_table *wait) {
+	struct WiegandBean *w = file->private_data;
+
+	poll_wait(file, &w->framesWq, wait);
+	if (!kfifo_is_empty(&w->frames)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static const struct file_operations wiegandFramesFops = {
+	.owner = THIS_MODULE,
+	.open = wiegandFramesOpen,
+	.read = wiegandFramesRead,
+	.poll = wiegandFramesPoll,
+};
+
+/*
+ * Allowlist being written through one open file.
+ */
+struct WiegandAllowLoad {
+	struct WiegandBean *w;
+	struct mutex lock;
+	struct WiegandAllowList *list;
+	size_t len;
+	size_t cap;
+	bool written;
+	bool clear;
+	int err;
+};
+
+static int wiegandAllowOpen(struct inode *inode, struct file *file) {
+	struct WiegandAllowLoad *l;
+
+	l = kzalloc(sizeof(*l), GFP_KERNEL);
+	if (l == NULL) {
+		return -ENOMEM;
+	}
+	l->w = container_of(file->private_data, struct WiegandBean, allowMisc);
+	mutex_init(&l->lock);
+	// an empty list is only loaded on request, e.g. by ": > file"
+	l->clear = (file->f_mode & FMODE_WRITE) && (file->f_flags & O_TRUNC);
+	file->private_data = l;
+	return 0;
+}
+
+static ssize_t wiegandAllowRead(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct WiegandAllowLoad *l = file->private_data;
+	struct WiegandBean *w = l->w;
+	struct WiegandAllowList *list;
+	ssize_t ret = 0;
+
+	// the list is only replaced with allowLock held
+	mutex_lock(&w->allowLock);
+	list = rcu_dereference_protected(w->allow,
+			lockdep_is_held(&w->allowLock));
+	if (list != NULL) {
+		ret = simple_read_from_buffer(buf, count, ppos, list->cards,
+				list->count * sizeof(list->cards[0]));
+	}
+	mutex_unlock(&w->allowLock);
+
+	return ret;
+}
+
+/*
+ * Appends the records to the list being loaded, which replaces the current
+ * one when the file is closed. Invalid records fail the write and discard
+ * the whole list.
+ */
+static ssize_t wiegandAllowWrite(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct WiegandAllowLoad *l = file->private_data;
+	struct WiegandAllowList *list;
+	size_t cap, i;
+	ssize_t ret;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	mutex_lock(&l->lock);
+	if (l->err) {
+		ret = l->err;
+		goto out;
+	}
+	if (l->len + count
+			> WIEGAND_ALLOW_MAX * sizeof(struct exosensepi_wiegand_card)) {
+		ret = -EFBIG;
+		goto fail;
+	}
+	if (l->list == NULL || l->len + count > l->cap) {
+		cap = max3(l->cap * 2, l->len + count, (size_t) PAGE_SIZE);
+		list = kvmalloc(sizeof(*list) + cap, GFP_KERNEL);
+		if (list == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+		if (l->list != NULL) {
+			memcpy(list->cards, l->list->cards, l->len);
+			kvfree(l->list);
+		}
+		l->list = list;
+		l->cap = cap;
+	}
+	if (copy_from_user((u8*) l->list->cards + l->len, buf, count)) {
+		ret = -EFAULT;
+		goto fail;
+	}
+	// the records completed by this write
+	for (i = l->len / sizeof(l->list->cards[0]);
+			i < (l->len + count) / sizeof(l->list->cards[0]); i++) {
+		if (l->list->cards[i].reserved != 0) {
+			ret = -EINVAL;
+			goto fail;
+		}
+	}
+	l->len += count;
+	l->written = true;
+	ret = count;
+	goto out;
+
+	fail:
+	// the current list is kept, whatever is written next
+	l->err = ret;
+	out:
+	mutex_unlock(&l->lock);
+	return ret;
+}
+
+/*
+ * Replaces the current list with the one written, if any, so that errors
+ * are reported by close().
+ */
+static int wiegandAllowFlush(struct file *file, fl_owner_t id) {
+	struct WiegandAllowLoad *l = file->private_data;
+	struct WiegandBean *w = l->w;
+	struct WiegandAllowList *list, *old;
+	int ret = 0;
+
+	if (!(file->f_mode & FMODE_WRITE)) {
+		return 0;
+	}
+
+	mutex_lock(&l->lock);
+	if (l->err) {
+		ret = l->err;
+		goto out;
+	}
+	if (!l->written && !l->clear) {
+		goto out;
+	}
+	if (l->len % sizeof(l->list->cards[0]) != 0) {
+		// a partial record, nothing to load
+		ret = -EINVAL;
+		l->err = ret;
+		goto out;
+	}
+
+	list = l->list;
+	if (list != NULL) {
+		list->count = l->len / sizeof(list->cards[0]);
+		sort(list->cards, list->count, sizeof(list->cards[0]),
+				wiegandCardCmp, NULL);
+	}
+
+	mutex_lock(&w->allowLock);
+	old = rcu_dereference_protected(w->allow,
+			lockdep_is_held(&w->allowLock));
+	rcu_assign_pointer(w->allow, list);
+	mutex_unlock(&w->allowLock);
+
+	// lookups from the timer may still be using the old list
+	synchronize_rcu();
+	kvfree(old);
+
+	// a duplicate of the file being closed later must not load it again
+	l->list = NULL;
+	l->len = 0;
+	l->cap = 0;
+	l->written = false;
+	l->clear = false;
+
+	out:
+	mutex_unlock(&l->lock);
+	return ret;
+}
+
+static int wiegandAllowRelease(struct inode *inode, struct file *file) {
+	struct WiegandAllowLoad *l = file->private_data;
+
+	kvfree(l->list);
+	kfree(l);
+	return 0;
+}
+
+static const struct file_operations wiegandAllowFops = {
+	.owner = THIS_MODULE,
+	.open = wiegandAllowOpen,
+	.read = wiegandAllowRead,
+	.write = wiegandAllowWrite,
+	.llseek = default_llseek,
+	.flush = wiegandAllowFlush,
+	.release = wiegandAllowRelease,
+};
+
+int wiegandDevRegister(struct WiegandBean *w) {
+	int res;
+
+	w->misc.minor = MISC_DYNAMIC_MINOR;
+	w->misc.fops = &wiegandFramesFops;
+	res = misc_register(&w->misc);
+	if (res) {
+		return res;
+	}
+	w->miscRegistered = true;
+
+	w->allowMisc.minor = MISC_DYNAMIC_MINOR;
+	w->allowMisc.fops = &wiegandAllowFops;
+	res = misc_register(&w->allowMisc);
+	if (res) {
+		return res;
+	}
+	w->allowMiscRegistered = true;
+	return 0;
+}
+
+void wiegandDevDeregister(struct WiegandBean *w) {
+	if (w->miscRegistered) {
+		misc_deregister(&w->misc);
+		w->miscRegistered = false;
+	}
+	if (w->allowMiscRegistered) {
+		misc_deregister(&w->allowMisc);
+		w->allowMiscRegistered = false;
+	}
+}
@@ -2,7 +2,25 @@
 #define _SL_WIEGAND_H
 
 #include "../gpio/gpio.h"
+#include "../uapi/exosensepi.h"
 #include <linux/device.h>
+#include <linux/kfifo.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/wait.h>
+
+#define WIEGAND_MAX_BITS EXOSENSEPI_WIEGAND_MAX_BITS
+#define WIEGAND_FRAMES_SIZE 64
+#define WIEGAND_FORMATS_MAX 16
+#define WIEGAND_FORMAT_PARITIES 3
+#define WIEGAND_FORMAT_NAME_LEN 16
+#define WIEGAND_ALLOW_MAX 1048576
+#define WIEGAND_ACTION_MAX_MSEC 3600000
+#define WIEGAND_KEYPAD_OFF 0
+#define WIEGAND_KEYPAD_PIN 1
+#define WIEGAND_KEYPAD_CARD_PIN 2
+#define WIEGAND_KEYPAD_TIMEOUT_DEFAULT_USEC 5000000ul
 
 struct WiegandLine {
 	struct GpioBean *gpio;
@@ -11,6 +29,57 @@ struct WiegandLine {
 	bool wasLow;
 };
 
+/*
+ * Frame bits are stored as a bit stream: bit i (0 = first received) is
+ * bits[i / 8] & (0x80 >> (i % 8)).
+ */
+static inline bool wiegandBit(const u8 *bits, unsigned int i) {
+	return bits[i / 8] & (0x80 >> (i % 8));
+}
+
+/*
+ * mask selects the bits covered by the check, parity bit included.
+ */
+struct WiegandParity {
+	u8 mask[WIEGAND_MAX_BITS / 8];
+	bool odd;
+};
+
+/*
+ * Frame format, matched on the number of bits. Fields are given as offset
+ * from the first bit received and length; a zero length field is not
+ * present.
+ */
+struct WiegandFormat {
+	char name[WIEGAND_FORMAT_NAME_LEN];
+	unsigned int bits;
+	unsigned int facilityOffset;
+	unsigned int facilityLen;
+	unsigned int cardOffset;
+	unsigned int cardLen;
+	unsigned int parityCount;
+	struct WiegandParity parity[WIEGAND_FORMAT_PARITIES];
+};
+
+/*
+ * Allowlist sorted by facility code and card number, replaced as a whole
+ * and freed after an RCU grace period.
+ */
+struct WiegandAllowList {
+	unsigned int count;
+	struct exosensepi_wiegand_card cards[];
+};
+
+/*
+ * Output pulsed when a card is granted or denied, none if NULL. Chosen
+ * among the NULL-terminated WiegandBean.outputs, by the part of their name
+ * after the last '_'.
+ */
+struct WiegandAction {
+	struct GpioBean *gpio;
+	unsigned long pulse_usec;
+};
+
 struct WiegandBean {
 	char id;
 	struct WiegandLine d0;
@@ -21,18 +90,58 @@ struct WiegandBean {
 	unsigned long pulseWidthMin_usec;
 	unsigned long pulseWidthMax_usec;
 	bool enabled;
-	uint64_t data;
+	spinlock_t lock;
+	u8 data[WIEGAND_MAX_BITS / 8];
 	int bitCount;
+	bool framePushed;
 	int noise;
 	struct timespec64 lastBitTs;
 	struct hrtimer timer;
 	struct kernfs_node *notifKn;
+	struct WiegandFormat formats[WIEGAND_FORMATS_MAX];
+	unsigned int formatsCount;
+	struct exosensepi_wiegand_frame last;
+	DECLARE_KFIFO_PTR(frames, struct exosensepi_wiegand_frame);
+	unsigned int framesLost;
+	wait_queue_head_t framesWq;
+	struct miscdevice misc;
+	bool miscRegistered;
+	struct WiegandAllowList __rcu *allow;
+	struct mutex allowLock;
+	struct GpioBean **outputs;
+	struct WiegandAction grant;
+	struct WiegandAction deny;
+	struct miscdevice allowMisc;
+	bool allowMiscRegistered;
+	int keypad;
+	unsigned long keypadTimeout_usec;
+	unsigned int keypadMaxLen;
+	char pin[EXOSENSEPI_WIEGAND_PIN_MAX + 1];
+	unsigned int pinLen;
+	u64 pinTs;
+	struct exosensepi_wiegand_frame pinCard;
+	bool pinCardValid;
+	ktime_t pinDeadline;
+	struct hrtimer keypadTimer;
+	struct exosensepi_wiegand_frame lastPin;
+	bool pinNotify;
+	struct kernfs_node *pinNotifKn;
 };
 
-void wiegandInit(struct WiegandBean *w);
+int wiegandInit(struct WiegandBean *w);
+
+void wiegandFree(struct WiegandBean *w);
 
 void wiegandDisable(struct WiegandBean *w);
 
+/*
+ * Registers the character devices streaming the completed frames and
+ * loading the allowlist, named after misc.name and allowMisc.name.
+ */
+int wiegandDevRegister(struct WiegandBean *w);
+
+void wiegandDevDeregister(struct WiegandBean *w);
+
 ssize_t devAttrWiegandEnabled_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
@@ -42,6 +151,57 @@ ssize_t devAttrWiegandEnabled_store(struct device *dev,
 ssize_t devAttrWiegandData_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
+ssize_t devAttrWiegandDataHex_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandDataBin_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandCard_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandFormats_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandFormats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandAllowCount_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandGrantAction_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandGrantAction_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandDenyAction_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandDenyAction_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandKeypad_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandKeypad_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandKeypadTimeout_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandKeypadTimeout_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandKeypadMaxLen_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
+ssize_t devAttrWiegandKeypadMaxLen_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count);
+
+ssize_t devAttrWiegandPin_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+
 ssize_t devAttrWiegandNoise_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 